@@ -0,0 +1,166 @@
+//******************************************************************************
+// Copyright (c) 2016, enferex <mattdavis9@gmail.com>
+//
+// ISC License:
+// https://www.isc.org/downloads/software-support-policy/isc-license/
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+// REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+// AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+// OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+//******************************************************************************
+
+// Counts allocations for --stats.  This is linked into the fnplot program
+// (and the benchmark) only, so that programs using libfnplot keep their own
+// operator new.
+
+#include <cstdlib>
+#include <new>
+#include "stats.hh"
+
+// Count an allocation of 'size' bytes, aligned to 'align' if that is more
+// than malloc's, and return it or NULL
+static void *allocate(size_t size, size_t align=0)
+{
+    void *p;
+
+    cs_stats.allocs.fetch_add(1, std::memory_order_relaxed);
+    cs_stats.alloc_bytes.fetch_add(size, std::memory_order_relaxed);
+    if (!size)
+      size = 1;
+    if (align <= __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+      return malloc(size);
+    if (align < sizeof(void *))
+      align = sizeof(void *);
+    return posix_memalign(&p, align, size) ? NULL : p;
+}
+
+// Count every allocation made through new, in each of its forms, so that
+// each is freed by the delete that matches it
+void *operator new(size_t size)
+{
+    void *p;
+
+    if (!(p = allocate(size)))
+      throw std::bad_alloc();
+    return p;
+}
+
+void *operator new[](size_t size)
+{
+    void *p;
+
+    if (!(p = allocate(size)))
+      throw std::bad_alloc();
+    return p;
+}
+
+void *operator new(size_t size, std::align_val_t align)
+{
+    void *p;
+
+    if (!(p = allocate(size, (size_t)align)))
+      throw std::bad_alloc();
+    return p;
+}
+
+void *operator new[](size_t size, std::align_val_t align)
+{
+    void *p;
+
+    if (!(p = allocate(size, (size_t)align)))
+      throw std::bad_alloc();
+    return p;
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+    return allocate(size);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept
+{
+    return allocate(size);
+}
+
+void *operator new(size_t size, std::align_val_t align,
+                   const std::nothrow_t &) noexcept
+{
+    return allocate(size, (size_t)align);
+}
+
+void *operator new[](size_t size, std::align_val_t align,
+                     const std::nothrow_t &) noexcept
+{
+    return allocate(size, (size_t)align);
+}
+
+// Everything above came from malloc or posix_memalign, so free() it all
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept
+{
+    free(p);
+}
+
+void operator delete(void *p, std::align_val_t) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void *p, std::align_val_t) noexcept
+{
+    free(p);
+}
+
+void operator delete(void *p, size_t, std::align_val_t) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void *p, size_t, std::align_val_t) noexcept
+{
+    free(p);
+}
+
+void operator delete(void *p, const std::nothrow_t &) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void *p, const std::nothrow_t &) noexcept
+{
+    free(p);
+}
+
+void operator delete(void *p, std::align_val_t,
+                     const std::nothrow_t &) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void *p, std::align_val_t,
+                       const std::nothrow_t &) noexcept
+{
+    free(p);
+}
@@ -0,0 +1,125 @@
+//******************************************************************************
+// Copyright (c) 2016, enferex <mattdavis9@gmail.com>
+//
+// ISC License:
+// https://www.isc.org/downloads/software-support-policy/isc-license/
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+// REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+// AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+// OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+//******************************************************************************
+
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include "arena.hh"
+#include "stats.hh"
+
+CSArena::~CSArena()
+{
+    for (auto chunk: _chunks)
+      free(chunk);
+}
+
+void *CSArena::alloc(size_t size, size_t align)
+{
+    size_t pad = (align - ((uintptr_t)_cur & (align - 1))) & (align - 1);
+
+    if (pad + size > _left) {
+        size_t len = _chunk_size;
+        if (_chunk_size < CHUNK_MAX)
+          _chunk_size *= 2;
+
+        // Oversized requests get a chunk of their own
+        if (size + align > len)
+          len = size + align;
+
+        if (!(_cur = (char *)malloc(len)))
+          throw std::bad_alloc();
+        _chunks.push_back(_cur);
+        ++cs_stats.arena_chunks;
+        cs_stats.arena_bytes += len;
+        _left = len;
+        pad = (align - ((uintptr_t)_cur & (align - 1))) & (align - 1);
+    }
+
+    void *p = _cur + pad;
+    _cur += pad + size;
+    _left -= pad + size;
+    return p;
+}
+
+void CSStrTab::grow()
+{
+    rehash(_slots.size() ? _slots.size() * 2 : 64);
+}
+
+// Make room for 'n' strings without rehashing as they are added
+void CSStrTab::reserve(size_t n)
+{
+    size_t cap = 64;
+
+    while (cap < n * 2)
+      cap *= 2;
+    _strs.reserve(n);
+    if (cap > _slots.size())
+      rehash(cap);
+}
+
+void CSStrTab::rehash(size_t cap)
+{
+    _slots.assign(cap, 0);
+    _mask = cap - 1;
+    for (uint32_t id=0; id<_strs.size(); ++id) {
+        size_t i = std::hash<std::string_view>()(_strs[id]) & _mask;
+        while (_slots[i])
+          i = (i + 1) & _mask;
+        _slots[i] = id + 1;
+    }
+}
+
+bool CSStrTab::find(std::string_view s, uint32_t *id) const
+{
+    if (_slots.empty())
+      return false;
+
+    size_t i = std::hash<std::string_view>()(s) & _mask;
+    for ( ; _slots[i]; i = (i + 1) & _mask) {
+        if (_strs[_slots[i] - 1] == s) {
+            *id = _slots[i] - 1;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+uint32_t CSStrTab::intern(std::string_view s)
+{
+    // Keep the load factor under 1/2
+    if ((_strs.size() + 1) * 2 > _slots.size())
+      grow();
+
+    size_t i = std::hash<std::string_view>()(s) & _mask;
+    for ( ; _slots[i]; i = (i + 1) & _mask)
+      if (_strs[_slots[i] - 1] == s)
+        return _slots[i] - 1;
+
+    // New string: copy it into the arena (NUL terminated for C callers)
+    char *str = (char *)_arena.alloc(s.size() + 1, 1);
+    memcpy(str, s.data(), s.size());
+    str[s.size()] = '\0';
+
+    uint32_t id = _strs.size();
+    _strs.push_back(std::string_view(str, s.size()));
+    _slots[i] = id + 1;
+    return id;
+}
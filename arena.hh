@@ -0,0 +1,84 @@
+//******************************************************************************
+// Copyright (c) 2016, enferex <mattdavis9@gmail.com>
+//
+// ISC License:
+// https://www.isc.org/downloads/software-support-policy/isc-license/
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+// REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+// AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+// OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+//******************************************************************************
+
+#ifndef _ARENA_HH
+#define _ARENA_HH
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Bump allocator: objects are carved out of large chunks and are all
+// released at once when the arena is destroyed.  Only use it for trivially
+// destructible types, destructors are never run.
+class CSArena
+{
+public:
+    CSArena() : _cur(nullptr), _left(0), _chunk_size(CHUNK_MIN) {}
+    ~CSArena();
+    CSArena(const CSArena &) = delete;
+    CSArena &operator=(const CSArena &) = delete;
+
+    void *alloc(size_t size, size_t align=alignof(std::max_align_t));
+    size_t getChunkCount() const { return _chunks.size(); }
+
+    template <typename T, typename... Args> T *make(Args&&... args) {
+        return new (alloc(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+private:
+    // Chunks double in size from CHUNK_MIN up to CHUNK_MAX, so small files
+    // stay small and large ones need few chunks.
+    static const size_t CHUNK_MIN = 4096;
+    static const size_t CHUNK_MAX = 1 << 20;
+
+    std::vector<char *> _chunks;
+    char               *_cur;
+    size_t              _left;
+    size_t              _chunk_size;
+};
+
+// String interner: each distinct string is stored once (in an arena) and
+// gets a dense id.  Interned strings of the same table can be compared by
+// pointer.
+class CSStrTab
+{
+public:
+    CSStrTab() : _mask(0) {}
+
+    // Return the id of 's', adding it if it is not yet in the table
+    uint32_t intern(std::string_view s);
+    bool find(std::string_view s, uint32_t *id) const;
+    void reserve(size_t n);
+    std::string_view get(uint32_t id) const { return _strs[id]; }
+    size_t size() const { return _strs.size(); }
+
+private:
+    CSArena                       _arena;
+    std::vector<std::string_view> _strs;  // id -> string
+    std::vector<uint32_t>         _slots; // Open addressing, id+1 (0: empty)
+    size_t                        _mask;
+
+    void grow();
+    void rehash(size_t cap);
+};
+
+#endif // _ARENA_HH
@@ -0,0 +1,136 @@
+//******************************************************************************
+// Copyright (c) 2016, enferex <mattdavis9@gmail.com>
+//
+// ISC License:
+// https://www.isc.org/downloads/software-support-policy/isc-license/
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+// REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+// AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+// OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+//******************************************************************************
+
+// Time each stage of fnplot on a cscope database: loading and parsing it
+// (CS::CS), building the call graph (CS::buildDatabase), and callers and
+// callees queries of a random sample of functions at several depths.
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include <unistd.h>
+#include "../cs.hh"
+
+typedef std::chrono::steady_clock Clock;
+
+static const int depths[] = {1, 2, 4, 0};
+
+static double msSince(Clock::time_point st)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - st).count();
+}
+
+static void usage(const char *execname)
+{
+    printf("Usage: %s [-j threads] [-q queries] [-s seed] cscope.out\n"
+           "  -j threads: Parse the database with this many threads.\n"
+           "  -q queries: Functions to query at each depth (default 100).\n"
+           "  -s seed:    Random seed for picking functions (default 1).\n"
+           "  -h:         This help message.\n",
+           execname);
+    exit(EXIT_SUCCESS);
+}
+
+int main(int argc, char **argv)
+{
+    int opt, n_threads = 1;
+    long n_queries = 100, seed = 1;
+    const char *fname;
+    FILE *null;
+    CS *cs;
+    CSDB *db;
+    Clock::time_point st;
+    double load_ms, build_ms;
+
+    while ((opt = getopt(argc, argv, "j:q:s:h")) != -1) {
+        switch (opt) {
+        case 'j': n_threads = atoi(optarg); break;
+        case 'q': n_queries = atol(optarg); break;
+        case 's': seed = atol(optarg); break;
+        case 'h': usage(argv[0]); break;
+        default: return EXIT_FAILURE;
+        }
+    }
+
+    if (optind != argc - 1 || n_threads < 1 || n_queries < 1) {
+        fprintf(stderr, "Invalid options, see '-h'\n");
+        return EXIT_FAILURE;
+    }
+    fname = argv[optind];
+
+    if (!(null = fopen("/dev/null", "w"))) {
+        perror("/dev/null");
+        return EXIT_FAILURE;
+    }
+
+    try {
+        st = Clock::now();
+        cs = new CS(fname, n_threads);
+        load_ms = msSince(st);
+
+        st = Clock::now();
+        db = cs->buildDatabase();
+        build_ms = msSince(st);
+    }
+    catch (const char *err) {
+        fprintf(stderr, "Error loading cscope database: %s\n", err);
+        return EXIT_FAILURE;
+    }
+
+    // Query the same functions at each depth
+    std::mt19937_64 rng(seed);
+    std::vector<std::string> fns;
+    for (long i=0; i<n_queries && db->getFunctionCount(); ++i)
+      fns.emplace_back(db->getName(rng() % db->getFunctionCount()));
+
+    printf("database:            %s\n"
+           "threads:             %d\n"
+           "functions:           %zu\n"
+           "edges:               %zu\n"
+           "load (CS::CS):       %10.2f ms\n"
+           "buildDatabase:       %10.2f ms\n",
+           fname, n_threads, db->getFunctionCount(), db->getEdgeCount(),
+           load_ms, build_ms);
+
+    for (int depth: depths) {
+        for (int callers=1; callers>=0; --callers) {
+            st = Clock::now();
+            for (const auto &fn: fns) {
+                if (callers)
+                  csPrintCallers(null, db, fn.c_str(), depth);
+                else
+                  csPrintCallees(null, db, fn.c_str(), depth);
+            }
+            double ms = msSince(st);
+
+            char what[32];
+            snprintf(what, sizeof(what), "%s -d %s:",
+                     callers ? "callers" : "callees",
+                     depth ? std::to_string(depth).c_str() : "inf");
+            printf("%-20s %10.2f ms (%.1f us/query)\n",
+                   what, ms, fns.empty() ? 0.0 : ms * 1000.0 / fns.size());
+        }
+    }
+
+    fclose(null);
+    delete db;
+    delete cs;
+    return 0;
+}
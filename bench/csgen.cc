@@ -0,0 +1,369 @@
+//******************************************************************************
+// Copyright (c) 2016, enferex <mattdavis9@gmail.com>
+//
+// ISC License:
+// https://www.isc.org/downloads/software-support-policy/isc-license/
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+// REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+// AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+// OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+//******************************************************************************
+
+// Write a synthetic cscope database (uncompressed, as from cscope -c) with a
+// call graph shaped like a real C project: functions are spread over files
+// in a handful of directories, most calls go to functions a little further
+// on (helpers near their callers), some go anywhere, some go to undefined
+// library functions, and 'cycle density' of them go backwards, forming
+// cycles.  Each function's fan-out is uniform in [0, 2 * fanout].
+//
+// Optionally some functions are static helpers, named after a function a
+// little further on, the database is compressed as cscope does without -c,
+// or it comes with the inverted index that cscope -q builds.
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include "../inv.hh"
+
+static const char *lib_fns[] = {
+    "printf", "fprintf", "snprintf", "malloc", "calloc", "realloc", "free",
+    "memcpy", "memset", "memcmp", "strlen", "strcmp", "strncpy", "abort"
+};
+#define N_LIB_FNS (sizeof(lib_fns) / sizeof(lib_fns[0]))
+
+// cscope's compression: the keyword "static" (and its blank) is a single
+// byte, then each pair of a character from dichar1 and one from dichar2 is
+// a byte with the high bit set.  Marks and file names are left alone.
+static const char dichar1[] = " teisaprnl(of)=c";
+static const char dichar2[] = " tnerpla";
+#define KEYWORD_STATIC '\030'
+
+static std::string digraphs(const std::string &text)
+{
+    std::string out;
+
+    for (size_t i=0; i<text.size(); ++i) {
+        const char *c1 = strchr(dichar1, text[i]);
+        const char *c2 = i + 1 < text.size() ? strchr(dichar2, text[i+1])
+                                              : NULL;
+        if (text[i] && c1 && text[i+1] && c2) {
+            out += (char)(0x80 + (c1 - dichar1) * 8 + (c2 - dichar2));
+            ++i;
+        }
+        else
+          out += text[i];
+    }
+    return out;
+}
+
+static std::string compress(const std::string &body)
+{
+    std::string out;
+    size_t end;
+
+    for (size_t start=0; start<body.size(); start=end+1) {
+        std::string line;
+        size_t at;
+
+        end = body.find('\n', start);
+        line = body.substr(start, end - start);
+        if (line.compare(0, 2, "\t@") == 0)
+          out += line;
+        else if (line[0] == '\t' && line.size() > 1)
+          out += line.substr(0, 2) + digraphs(line.substr(2));
+        else {
+            if ((at = line.find("static ")) != std::string::npos)
+              line.replace(at, 7, 1, KEYWORD_STATIC);
+            out += digraphs(line);
+        }
+        out += '\n';
+    }
+    return out;
+}
+
+// The function definitions and calls in 'body', by name, with where they
+// are relative to it
+typedef std::map<std::string, std::vector<CSInvPosting>> Terms;
+static Terms findTerms(const std::string &body)
+{
+    Terms terms;
+    long file = -1;
+
+    for (size_t at=0; at<body.size(); at=body.find('\n', at) + 1) {
+        size_t end = body.find('\n', at);
+        CSInvPosting p = {};
+
+        if (body[at] != '\t')
+          continue;
+        if (body[at+1] == '@')
+          ++file;
+        if (body[at+1] != '$' && body[at+1] != '`')
+          continue;
+        p.lineoffset = at;
+        p.fileindex = file;
+        p.type = body[at+1];
+        terms[body.substr(at + 2, end - at - 2)].push_back(p);
+    }
+    return terms;
+}
+
+// cscope names the index files after the database: cscope.out has
+// cscope.in.out and cscope.po.out
+static std::string indexName(const std::string &dbname, const char *kind)
+{
+    size_t slash = dbname.rfind('/'), dot = dbname.rfind('.');
+
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+      return dbname + "." + kind;
+    return dbname.substr(0, dot) + "." + kind + dbname.substr(dot);
+}
+
+static size_t align(size_t n)
+{
+    return (n + sizeof(long) - 1) & ~(sizeof(long) - 1);
+}
+
+// Write the index cscope -q would for 'dbname', whose symbols start at
+// 'start' (see inv.hh).  The terms are in order in logical blocks of
+// cscope.in.out, found through the superfinger (the first term of each
+// block), and each is followed by the offset of its postings in
+// cscope.po.out.
+static bool writeIndex(const std::string &dbname, const Terms &terms,
+                       size_t start)
+{
+    const long sizeblk = 8192;
+    std::vector<std::vector<Terms::const_iterator>> blocks;
+    std::vector<CSInvPosting> postings;
+    std::vector<long> post_off;
+    std::string super, inv;
+    size_t used = sizeblk;
+    CSInvParam param = {};
+    FILE *fp;
+
+    for (auto it=terms.begin(); it!=terms.end(); ++it) {
+        size_t need = sizeof(CSInvEntry) + align(it->first.size()) +
+                      sizeof(long);
+        if (used + need > (size_t)sizeblk) {
+            blocks.emplace_back();
+            used = 3 * sizeof(long);
+        }
+        blocks.back().push_back(it);
+        used += need;
+        post_off.push_back(postings.size() * sizeof(CSInvPosting));
+        for (auto p: it->second) {
+            p.lineoffset += start;
+            postings.push_back(p);
+        }
+    }
+
+    // The superfinger: the block count, each block's first term's offset,
+    // then the terms
+    super.resize((blocks.size() + 1) * sizeof(long));
+    ((long *)&super[0])[0] = blocks.size();
+    for (size_t b=0; b<blocks.size(); ++b) {
+        ((long *)&super[0])[b+1] = super.size();
+        super += blocks[b][0]->first + '\0';
+    }
+
+    param.version = 1;
+    param.sizeblk = sizeblk;
+    param.startbyte = sizeof(param);
+    param.supsize = super.size();
+    param.cntlsize = align(param.startbyte + param.supsize);
+    inv.assign((char *)&param, sizeof(param));
+    inv += super;
+    inv.resize(param.cntlsize + blocks.size() * sizeblk);
+
+    // Each block: <n terms> <next> <prev> <entries...> ... <terms>
+    size_t k = 0;
+    for (size_t b=0; b<blocks.size(); ++b) {
+        char *blk = &inv[param.cntlsize + b * sizeblk];
+        auto entries = (CSInvEntry *)(blk + 3 * sizeof(long));
+        size_t off = align(3 * sizeof(long) +
+                           blocks[b].size() * sizeof(CSInvEntry));
+
+        ((long *)blk)[0] = blocks[b].size();
+        for (size_t i=0; i<blocks[b].size(); ++i, ++k) {
+            const std::string &term = blocks[b][i]->first;
+            entries[i].offset = off;
+            entries[i].size = term.size();
+            entries[i].post = blocks[b][i]->second.size();
+            memcpy(blk + off, term.data(), term.size());
+            off += align(term.size());
+            memcpy(blk + off, &post_off[k], sizeof(long));
+            off += sizeof(long);
+        }
+    }
+
+    if (!(fp = fopen(indexName(dbname, "in").c_str(), "w")))
+      return false;
+    fwrite(inv.data(), 1, inv.size(), fp);
+    if (fclose(fp) ||
+        !(fp = fopen(indexName(dbname, "po").c_str(), "w")))
+      return false;
+    fwrite(postings.data(), sizeof(CSInvPosting), postings.size(), fp);
+    return fclose(fp) == 0;
+}
+
+static void usage(const char *execname)
+{
+    printf("Usage: %s [-f files] [-n functions] [-o fanout] [-y cycles] "
+           "[-t statics] [-s seed] [-z | -q] cscope.out\n"
+           "  -f files:     Number of source files (default 1000).\n"
+           "  -n functions: Number of functions (default 20000).\n"
+           "  -o fanout:    Mean number of calls per function (default 6).\n"
+           "  -y cycles:    Fraction of calls that go backwards, forming\n"
+           "                cycles (default 0.05).\n"
+           "  -t statics:   Fraction of functions that are static helpers\n"
+           "                (default 0).\n"
+           "  -s seed:      Random seed (default 1).\n"
+           "  -z:           Compress the database, as cscope does without -c.\n"
+           "  -q:           Also write the inverted index, as cscope -q does.\n"
+           "  -h:           This help message.\n",
+           execname);
+    exit(EXIT_SUCCESS);
+}
+
+int main(int argc, char **argv)
+{
+    int opt;
+    long n_files = 1000, n_fns = 20000, fanout = 6, seed = 1;
+    double cycles = 0.05, statics = 0.0;
+    bool compressed = false, index = false;
+    FILE *out;
+
+    while ((opt = getopt(argc, argv, "f:n:o:y:t:s:zqh")) != -1) {
+        switch (opt) {
+        case 'f': n_files = atol(optarg); break;
+        case 'n': n_fns = atol(optarg); break;
+        case 'o': fanout = atol(optarg); break;
+        case 'y': cycles = atof(optarg); break;
+        case 't': statics = atof(optarg); break;
+        case 'z': compressed = true; break;
+        case 'q': index = true; break;
+        case 's': seed = atol(optarg); break;
+        case 'h': usage(argv[0]); break;
+        default: return EXIT_FAILURE;
+        }
+    }
+
+    if (optind != argc - 1 || n_files < 1 || n_fns < n_files || fanout < 0 ||
+        cycles < 0.0 || cycles > 1.0 || statics < 0.0 || statics > 1.0 ||
+        (compressed && index)) {
+        fprintf(stderr, "Invalid options, see '-h'\n");
+        return EXIT_FAILURE;
+    }
+
+    std::mt19937_64 rng(seed);
+    std::uniform_real_distribution<double> coin(0.0, 1.0);
+    std::uniform_int_distribution<long> n_calls(0, 2 * fanout);
+    std::uniform_int_distribution<long> near(1, 64);
+    std::vector<std::string> files;
+    std::string body;
+    char buf[256];
+    long fn = 0;
+
+    for (long f=0; f<n_files; ++f) {
+        long line = 1, last = (f + 1) * n_fns / n_files;
+
+        snprintf(buf, sizeof(buf), "src/mod%ld/file%ld.c", f % 16, f);
+        files.push_back(buf);
+        body += "\t@" + files.back() + "\n\n";
+
+        // Includes and a global, so there are other marks to skip over
+        body += std::to_string(line++) + " #include \n\t~<stdio.h\n>\n\n";
+        snprintf(buf, sizeof(buf), "%ld static int \n\tgstate%ld\n;\n\n",
+                 line++, f);
+        body += buf;
+
+        for ( ; fn < last; ++fn) {
+            // A static helper shares its name with a function defined later,
+            // which then keeps the name
+            bool is_static = statics > 0.0 && coin(rng) < statics;
+            long name = is_static ? std::min(fn + near(rng), n_fns - 1) : fn;
+
+            snprintf(buf, sizeof(buf), "%ld %sint \n\t$fn_%ld\n(int \narg\n)"
+                     "\n\n", ++line, is_static ? "static " : "", name);
+            body += buf;
+
+            for (long c=n_calls(rng); c>0; --c) {
+                double r = coin(rng);
+                long callee;
+
+                if (r < cycles)
+                  callee = (long)(coin(rng) * (fn + 1));
+                else if (r < cycles + 0.1) {
+                    snprintf(buf, sizeof(buf), "%ld \n\t`%s\n(\narg\n);\n\n",
+                             ++line, lib_fns[rng() % N_LIB_FNS]);
+                    body += buf;
+                    continue;
+                }
+                else if (r < 0.8)
+                  callee = fn + near(rng);
+                else
+                  callee = fn + 1 + (long)(coin(rng) * (n_fns - fn - 1));
+
+                if (callee >= n_fns)
+                  callee = n_fns - 1;
+                snprintf(buf, sizeof(buf), "%ld \n\t=arg\n = \n\t`fn_%ld\n(\n"
+                         "arg\n);\n\n", ++line, callee);
+                body += buf;
+            }
+
+            snprintf(buf, sizeof(buf), "%ld }\n\t}\n\n", ++line);
+            body += buf;
+            line += 2;
+        }
+    }
+    body += "\t@\n";
+    if (compressed)
+      body = compress(body);
+
+    // Header (fixed width, so the trailer offset is known), symbols, then
+    // the trailer: viewpaths, source dirs, include dirs, and source files.
+    // With an index the header also has its number of terms.
+    Terms terms;
+    std::string hdr = "cscope 15 /tmp/csgen ";
+    if (!compressed)
+      hdr += "-c ";
+    if (index) {
+        terms = findTerms(body);
+        snprintf(buf, sizeof(buf), "-q %010zu ", terms.size());
+        hdr += buf;
+    }
+    snprintf(buf, sizeof(buf), "%010zu\n", hdr.size() + 11 + body.size());
+    hdr += buf;
+    size_t names_len = 0;
+    for (const auto &f: files)
+      names_len += f.size() + 1;
+
+    if (!(out = fopen(argv[optind], "w"))) {
+        perror(argv[optind]);
+        return EXIT_FAILURE;
+    }
+    fputs(hdr.c_str(), out);
+    fwrite(body.data(), 1, body.size(), out);
+    fprintf(out, "1\n.\n0\n0\n%zu\n%zu\n", files.size(), names_len);
+    for (const auto &f: files)
+      fprintf(out, "%s\n", f.c_str());
+
+    if (fclose(out) ||
+        (index && !writeIndex(argv[optind], terms, hdr.size()))) {
+        perror(argv[optind]);
+        return EXIT_FAILURE;
+    }
+    return 0;
+}
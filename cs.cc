@@ -17,27 +17,39 @@
 // PERFORMANCE OF THIS SOFTWARE.
 //******************************************************************************
 
-#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
 #include <iterator>
+#include <mutex>
 #include <regex>
 #include <string>
+#include <thread>
 #include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <vector>
+#include <fcntl.h>
+#include <unistd.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include "cs.hh"
+#include "stats.hh"
 
-using std::cout;
-using std::endl;
-
-typedef struct { size_t off; size_t data_len; const uint8_t *data; } pos_t;
+typedef struct {
+    size_t         off;
+    size_t         data_len;
+    const uint8_t *data;
+    bool           compressed; // Symbols are digraph compressed
+} pos_t;
 
 // Cscope data stream accessors
-#define VALID(_p)     ((_p)->off <= (_p)->data_len)
-#define NXT_VALID(_p) ((_p)->off+1 <= (_p)->data_len)
+#define VALID(_p)     ((_p)->off < (_p)->data_len)
+#define NXT_VALID(_p) ((_p)->off+1 < (_p)->data_len)
 #define END(_p)       ((_p)->off >= (_p)->data_len)
-#define CH(_p)        (VALID(_p) ? (_p)->data[(_p)->off] : EOF)
 
 // Error handling and debugging
 #define ERR(...) do {fprintf(stderr,__VA_ARGS__);fputc('\n', stderr);} while(0)
@@ -47,40 +59,115 @@ typedef struct { size_t off; size_t data_len; const uint8_t *data; } pos_t;
 #define DBG(...)
 #endif
 
-static void getLine(pos_t *pos, char *buf, size_t buf_len)
+// Return the line at 'pos', without its '\n', and advance past it.  The line
+// is a view straight into the database.  memchr does the searching, as libc
+// vectorizes it far better than a byte at a time loop.
+static inline std::string_view getLine(pos_t *pos)
 {
-    size_t len, st = pos->off;
+    const char *st = (const char *)pos->data + pos->off;
+    const char *nl;
+    size_t len = 0;
+
+    if (VALID(pos)) {
+        len = pos->data_len - pos->off;
+        if ((nl = (const char *)memchr(st, '\n', len)))
+          len = nl - st;
+    }
 
-    // Get initial line (header line)
-    while (CH(pos) != EOF && CH(pos) != '\n')
-      ++pos->off;
+    pos->off += len + 1;
+    return std::string_view(st, len);
+}
 
-    len = pos->off - st; // Don't return the '\n'
-    ++pos->off;          // +1 to advance to the '\n'
-    if (END(pos) || len > buf_len)
-      return;
+// Leading number of 'line' (0 if none)
+static long toLong(std::string_view line)
+{
+    long val = 0;
+    std::from_chars(line.data(), line.data() + line.size(), val);
+    return val;
+}
+
+// Unless built with -c, cscope compresses its database: a byte with the high
+// bit set stands for one of 128 common character pairs, the first from
+// dichar1 and the second from dichar2.  (Keywords in non-symbol text are
+// compressed too, but that text is never looked at here.)
+static const char dichar1[] = " teisaprnl(of)=c";
+static const char dichar2[] = " tnerpla";
+
+// Return the symbol 'src', expanded into 'buf' if it has any digraphs
+static std::string_view decompress(std::string &buf, std::string_view src)
+{
+    size_t i = 0;
+
+    while (i < src.size() && !(src[i] & 0x80))
+      ++i;
+    if (i == src.size())
+      return src;
+
+    buf.assign(src.data(), i);
+    for ( ; i < src.size(); ++i) {
+        unsigned char c = src[i];
+        if (c & 0x80) {
+            c &= 0x7f;
+            buf += dichar1[c / 8];
+            buf += dichar2[c & 7];
+        }
+        else
+          buf += c;
+    }
+    return buf;
+}
+
+// Skip leading whitespace
+static std::string_view skipSpace(std::string_view line)
+{
+    size_t i = 0;
+    while (i < line.size() && isspace((unsigned char)line[i]))
+      ++i;
+    return line.substr(i);
+}
 
-    memcpy(buf, pos->data + st, len);
-    buf[len] = '\0';
+static CSFile *newFile(std::string_view line)
+{
+    line = skipSpace(line);
+    if (line.empty())
+      return new CSFile("", '\0');
+    return new CSFile(line.substr(1), line[0]);
 }
 
-static CSFile *newFile(const char *str)
+// Which characters are marks, indexed by character
+struct CSMarkTable
 {
-    const char *c = str;
+    bool marks[256];
 
-    // Skip whitespace
-    while (isspace(*c))
-      ++c;
+    constexpr CSMarkTable() : marks() {
+        for (char c: cs_marks)
+          marks[(unsigned char)c] = true;
+    }
+};
+static constexpr CSMarkTable mark_table;
 
-    return new CSFile(c+1, *c);
+static inline bool isMark(char c)
+{
+    return mark_table.marks[(unsigned char)c];
 }
 
-static bool isMark(char c)
+// Does the non-symbol text 'text' hold the keyword "static"?  A compressed
+// database has each keyword as a single byte, its index in cscope's keyword
+// table.
+#define CS_KEYWORD_STATIC '\030'
+static bool hasStatic(std::string_view text)
 {
-    unsigned i;
-    for (i=0; i<sizeof(cs_marks)/sizeof(cs_marks[0]); ++i)
-      if (c == cs_marks[i])
-        return true;
+    auto ident = [](char c) { return isalnum((unsigned char)c) || c == '_'; };
+    size_t at;
+
+    if (text.find(CS_KEYWORD_STATIC) != std::string_view::npos)
+      return true;
+    for (at = 0; (at = text.find("static", at)) != std::string_view::npos;
+         at += 6) {
+        if ((at == 0 || !ident(text[at-1])) &&
+            (at + 6 == text.size() || !ident(text[at+6])))
+          return true;
+    }
     return false;
 }
 
@@ -98,13 +185,18 @@ static bool isMark(char c)
 // Source:
 // ftp://ftp.eeng.dcu.ie/pub/ee454/cygwin/usr/share/doc/mlcscope-14.1.8/html/cscope.html
 //
-// Returns: function definition that was just added, or is being added to.
+// 'text' is the <line number><blank><non-symbol text> line.  A definition is
+// taken to be static if "static" comes before it on its line.
 static void loadSymbolsInFile(
-    CSFile *file,
-    pos_t  *pos,
-    long    lineno)
+    CSFile           *file,
+    pos_t            *pos,
+    std::string_view  text,
+    std::string      &name)
 {
-    char line[1024], *c, mark;
+    std::string_view line, sym;
+    uint32_t lineno = toLong(text);
+    bool is_static = hasStatic(text);
+    char mark;
 
     // Suck in only function calls or definitions for this lineno
     while (VALID(pos)) {
@@ -112,53 +204,49 @@ static void loadSymbolsInFile(
         //
         // <optional mark><symbol text>
         // This will be <blank> if end of symbol data.
-        getLine(pos, line, sizeof(line));
-        if (strlen(line) == 0)
+        line = getLine(pos);
+        if (line.empty())
           break;
 
-        c = line;
-
         // Skip spaces and not tabs
-        while (*c == ' ')
-          ++c;
+        line.remove_prefix(std::min(line.find_first_not_of(' '), line.size()));
 
         // <optional mark>
         mark = 0;
-        if (c[0] == '\t' && isMark(c[1])) {
-            mark = c[1];
-            c += 2;
+        if (line.size() >= 2 && line[0] == '\t' && isMark(line[1])) {
+            mark = line[1];
+            line.remove_prefix(2);
         }
 
         // Only accept function definitions or function calls
+        if (!mark)
+          is_static = is_static || hasStatic(line);
         if (!mark || (mark != CS_FN_DEF && mark != CS_FN_CALL))
           continue;
 
         // Skip lines only containing mark characters
-        if (isMark(c[0]) && strlen(c+1) == 0)
+        if (line.size() == 1 && isMark(line[0]))
           continue;
 
-        if (mark == CS_FN_CALL) {
-            CSFuncDef *fndef = file->getCurrentFunction();
-
-            // This is probably a macro
-            if (!fndef)
-              continue;
+        // Symbols are expanded as they are read, the database never is
+        sym = pos->compressed ? decompress(name, line) : line;
 
-            // We always allocate a new symbol
-            // so the next pointer for a call will be used as a
-            // list of all calls that the function defintiion makes.
-            fndef->addCallee(new CSFuncCall(c, mark, lineno, file));
+        if (mark == CS_FN_CALL) {
+            // No current function: this is probably a macro
+            // Otherwise the call is linked into the list of all calls that
+            // the function definition makes.
+            file->addFunctionCall(sym, lineno);
         }
         else if (mark == CS_FN_DEF) {
-            // Add fn definition to file: Most recently defined is first
-            file->addFunctionDef(new CSFuncDef(c, mark, lineno, file));
+            // Add fn definition to file
+            file->addFunctionDef(sym, lineno, is_static);
         }
 
-        if (strlen(c) == 0)
+        if (line.empty())
           continue;
 
         // <non-symbol text>
-        getLine(pos, line, sizeof(line));
+        getLine(pos);
     }
 }
 
@@ -166,13 +254,14 @@ static void loadSymbolsInFile(
 // This must start with the <mark><file> line.
 static void fileLoadSymbols(CSFile *file, pos_t *pos)
 {
-    long lineno;
-    char line[1024], *c;
+    size_t st;
+    std::string_view line;
+    std::string name; // Decompressed symbol
 
-    DBG("Loading: %s", file->name);
+    DBG("Loading: %s", file->getName().c_str());
 
     // <empty line>
-    getLine(pos, line, sizeof(line));
+    getLine(pos);
 
     // Now parse symbol information for eack line in 'file'
     while (VALID(pos)) {
@@ -184,180 +273,1574 @@ static void fileLoadSymbols(CSFile *file, pos_t *pos)
         // So there are two cases here:
         // 1) New set of symbols: <lineno><blank><non-symbol text>
         // 2) A new file: <mark><file>
-        getLine(pos, line, sizeof(line));
-        c = line;
-        while (isspace(*c))
-          ++c;
+        st = pos->off;
+        line = skipSpace(getLine(pos));
 
         // Case 2: New file
-        if (c[0] == '@') {
-            pos->off -= strlen(line);
+        if (!line.empty() && line[0] == '@') {
+            pos->off = st;
             return;
         }
 
         // Case 1: Symbols at line!
         // <line number><blank>
-        lineno = atol(c);
-        loadSymbolsInFile(file, pos, lineno);
+        loadSymbolsInFile(file, pos, line, name);
+    }
+}
+
+// Parse the file section starting at 'start' (its <mark><file> line) and
+// ending at 'end' (the next file's <mark><file> line, or the trailer).
+static CSFile *loadFileSection(
+    const uint8_t *data,
+    size_t         start,
+    size_t         end,
+    bool           compressed)
+{
+    pos_t pos = {0};
+    CSFile *file;
+
+    pos.off = start;
+    pos.data = data;
+    pos.data_len = end;
+    pos.compressed = compressed;
+
+    file = newFile(getLine(&pos));
+    fileLoadSymbols(file, &pos);
+    cs_stats.bytes_scanned += end - start;
+    return file;
+}
+
+// Return the offset of each file section (each "\t@<file>" line) in
+// [start, end).  Sections are independent and can be parsed in any order.
+// File marks are the only lines starting with "\t@", and '@' is rare
+// elsewhere, so hunt for '@' rather than walking every line.
+static std::vector<size_t> scanFileSections(
+    const uint8_t *data,
+    size_t         start,
+    size_t         end)
+{
+    std::vector<size_t> sections;
+    const uint8_t *c = data + start + 1, *first = data + start;
+    const uint8_t *last = data + end;
+
+    while (c < last && (c = (const uint8_t *)memchr(c, '@', last - c))) {
+        if (c[-1] == '\t' && (c - 1 == first || c[-2] == '\n'))
+          sections.push_back(c - 1 - data);
+        ++c;
     }
+
+    return sections;
+}
+
+// Identify the database open on 'fd' by its size, mtime and header line
+static bool readSource(int fd, CSDBSource *src)
+{
+    char buf[4096];
+    const char *nl;
+    ssize_t len;
+    struct stat st;
+
+    if (fstat(fd, &st) == -1 || (len = pread(fd, buf, sizeof(buf), 0)) < 0)
+      return false;
+    if ((nl = (const char *)memchr(buf, '\n', len)))
+      len = nl - buf;
+
+    src->size = st.st_size;
+    src->mtime = st.st_mtim.tv_sec;
+    src->mtime_nsec = st.st_mtim.tv_nsec;
+    src->hdr_hash = csHash(buf, len);
+    return true;
 }
 
-// Load a cscope database and return a pointer to the data
-CS::CS(const char *fname)
+// Load a cscope database and return a pointer to the data.
+// File sections that 'prev' already has, unchanged, are not parsed again.
+CS::CS(
+    const char *fname,
+    int         n_threads,
+    const CSDB *prev,
+    bool        load_symbols,
+    size_t      stream_budget) :
+    _hdr(), _trailer(), _src(), _name(fname), _n_functions(0),
+    _n_threads(n_threads), _data(nullptr), _data_len(0), _builder(nullptr),
+    _prev(prev)
 {
     FILE *fp;
     uint8_t *data;
     struct stat st;
 
-    if (!(fp = fopen(fname, "r")))
+    if (!(fp = strcmp(fname, "-") ? fopen(fname, "r") : stdin))
       throw("Could not open cscope database file");
 
-    // mmap the input cscope database
     fstat(fileno(fp), &st);
-    data = (uint8_t *)mmap(NULL, st.st_size,
-                           PROT_READ, MAP_PRIVATE, fileno(fp), 0);
-    if (!data)
-      throw("Error memory maping cscope database");
+    readSource(fileno(fp), &this->_src);
+
+    // Index the previous graph's files by fingerprint
+    if (prev)
+      for (size_t i=0; i<prev->getFileCount(); ++i)
+        this->_prev_files.insert(std::make_pair(prev->getFileHash(i), i));
+
+    // Pipes cannot be mapped, so they are always streamed
+    if (stream_budget || !S_ISREG(st.st_mode)) {
+        try {
+            streamSymbols(fileno(fp), S_ISREG(st.st_mode) ? st.st_size : 0,
+                          stream_budget ? stream_budget : CS_STREAM_BUDGET);
+        }
+        catch (...) {
+            if (fp != stdin)
+              fclose(fp);
+            throw;
+        }
+        if (fp != stdin)
+          fclose(fp);
+        return;
+    }
+
+    // mmap the input cscope database
+    {
+        CSPhaseTimer timer(CS_PHASE_MMAP);
+        data = (uint8_t *)mmap(NULL, st.st_size,
+                               PROT_READ, MAP_PRIVATE, fileno(fp), 0);
+    }
+    if (data == MAP_FAILED) {
+        fclose(fp);
+        throw("Error memory maping cscope database");
+    }
+    cs_stats.database_bytes += st.st_size;
 
     // Initialize the data
     initHeader(data, st.st_size);
     initTrailer(data, st.st_size);
-    initSymbols(data, st.st_size);
+    if (load_symbols)
+      initSymbols(data, st.st_size);
 
-    // Done loading data
-    munmap(data, st.st_size);
+    // The mapping stays around for lazily loaded sections
+    this->_data = data;
+    this->_data_len = st.st_size;
     fclose(fp);
 }
 
+CS::~CS()
+{
+    for (auto f: this->_files)
+      delete f;
+    for (auto pr: this->_sections)
+      delete pr.second;
+    free((void *)this->_hdr.dir);
+    if (this->_data)
+      munmap((void *)this->_data, this->_data_len);
+    delete this->_builder;
+}
+
+// Reports building progress, if set
+static std::atomic<CSProgressFn> progress(NULL);
+
+void csSetProgress(CSProgressFn fn)
+{
+    progress = fn;
+}
+
 // Create a database
 CSDB *CS::buildDatabase()
 {
-    int i = 0, sidx = 0;
-    const char spin[] = "-\\|/";
-    auto db = new CSDB;
+    size_t i = 0;
+    CSProgressFn report = progress;
+    CSPhaseTimer timer(CS_PHASE_BUILD);
+    CSDBBuilder builder(this->_prev);
+    std::vector<std::string_view> callees;
+    std::vector<uint32_t> lines;
+
+    // Streamed: the graph was built as the database was read
+    if (this->_builder) {
+        CSDB *db = this->_builder->finish(this->_src);
+        delete this->_builder;
+        this->_builder = NULL;
+        return db;
+    }
 
-    cout << "Building internal database: ";
+    if (report)
+      report(0, false);
     for (auto f: this->_files) {
-        for (auto fndef_pr: *f->getFunctions()) {
-            // Collect all calls this function (fndef) makes
-            std::vector<const CSFuncCall *> callees;
-            auto fndef = static_cast<const CSFuncDef *>(fndef_pr.second);
-            fndef->getCallees(callees);
+        size_t ticks = i / 1000;
+        i += addToBuilder(builder, f, callees, lines);
+        if (report && i / 1000 != ticks)
+          report(i, false);
+    }
+
+    if (report)
+      report(i, true);
+    return builder.finish(this->_src);
+}
 
-            // Add the funtion_def : calleess map entry
-            auto pr = std::make_pair(fndef->getName(), callees);
-            db->insert(pr);
-            if ((++i % 1000) == 0)
-              cout << '\b' << spin[sidx++ % 4] << std::flush;
+// Add file 'f' and its function definitions to 'builder'.  Returns the
+// number of definitions added.
+int CS::addToBuilder(
+    CSDBBuilder                   &builder,
+    const CSFile                  *f,
+    std::vector<std::string_view> &callees,
+    std::vector<uint32_t>         &lines)
+{
+    // Unchanged since the previous graph: copy its definitions over
+    if (f->getPrevious() >= 0) {
+        builder.addFileFrom(this->_prev, f->getPrevious());
+        return 0;
+    }
+
+    builder.addFile(f->getName(), f->getHash());
+
+    for (auto fndef = f->getFunctions(); fndef; fndef = fndef->getNext()) {
+        // Collect all calls this function (fndef) makes
+        callees.clear();
+        lines.clear();
+        for (auto call = fndef->getCallees(); call; call = call->getNext()) {
+            callees.push_back(call->getName());
+            lines.push_back(call->getLine());
+        }
+
+        // Add the funtion_def : calleess entry
+        builder.addFunction(fndef->getName(), fndef->getLine(),
+                            fndef->isStatic(), callees, lines);
+    }
+
+    return f->getFunctionCount();
+}
+
+// Load the call graph of cscope database 'fname', parsing with 'n_threads'.
+// With 'use_snapshot' the graph is mapped from the snapshot next to the
+// database (fname + CS_SNAPSHOT_EXT) when that is up to date, and the
+// snapshot is (re)written otherwise.
+//
+// Only the file sections that changed since 'prev', or since a stale
+// snapshot, are parsed; the rest are carried over from that graph.
+// 'stream_budget' streams the database in windows of that many bytes (see
+// CS::CS).
+CSDB *csLoadDatabase(
+    const char *fname,
+    int         n_threads,
+    bool        use_snapshot,
+    const CSDB *prev,
+    size_t      stream_budget)
+{
+    int fd;
+    CSDB *db, *snap_db = NULL;
+    CSDBSource src;
+    const string snap = string(fname) + CS_SNAPSHOT_EXT;
+
+    if (use_snapshot) {
+        CSPhaseTimer timer(CS_PHASE_SNAPSHOT);
+        if ((snap_db = CSDB::load(snap.c_str()))) {
+            bool ok = false;
+            if ((fd = open(fname, O_RDONLY)) != -1) {
+                ok = readSource(fd, &src);
+                close(fd);
+            }
+            if (ok && snap_db->getSource() == src)
+              return snap_db;
+            if (!prev)
+              prev = snap_db;
         }
     }
 
-    cout << '\b' << " Done " << endl;
+    // The parsed symbols are no longer needed once the graph is built
+    try {
+        CS cs(fname, n_threads, prev, true, stream_budget);
+        db = cs.buildDatabase();
+    }
+    catch (...) {
+        delete snap_db;
+        throw;
+    }
+
+    delete snap_db;
+    if (use_snapshot) {
+        CSPhaseTimer timer(CS_PHASE_SNAPSHOT);
+        if (!db->save(snap.c_str()))
+          ERR("Could not write snapshot %s: %s", snap.c_str(), strerror(errno));
+    }
+
     return db;
 }
 
-// Does a call b?
-static bool isCallerOf(CSDB *db, const char *a, const char *b)
+// Load the cscope databases 'fnames' and merge them into one graph.  The
+// databases are loaded concurrently, sharing out 'n_threads', and are then
+// merged in the order given: when several define the same function, the
+// first database to do so provides its calls.  cscope names files relative to
+// where it ran, so each file's name is qualified with its database's
+// directory, and files of the same name from databases in the same directory
+// are taken from the first.
+CSDB *csLoadDatabases(
+    const std::vector<const char *> &fnames,
+    int                              n_threads,
+    bool                             use_snapshot,
+    size_t                           stream_budget)
 {
-    // All the functions 'a' calls
-    for (auto callee: (*db)[a]) {
-        if (strcmp(callee->getName().c_str(), b) == 0)
-            return true;
+    const size_t n_dbs = fnames.size();
+    std::vector<CSDB *> dbs(n_dbs);
+    std::vector<const char *> errs(n_dbs);
+    std::vector<std::thread> threads;
+    std::atomic<size_t> next(0);
+    int per_db = std::max(1, n_threads / (int)n_dbs);
+
+    if (n_dbs == 1)
+      return csLoadDatabase(fnames[0], n_threads, use_snapshot, NULL,
+                            stream_budget);
+
+    auto worker = [&]() {
+        size_t i;
+        while ((i = next++) < n_dbs) {
+            try {
+                dbs[i] = csLoadDatabase(fnames[i], per_db, use_snapshot,
+                                        NULL, stream_budget);
+            }
+            catch (const char *err) {
+                errs[i] = err;
+            }
+        }
+    };
+
+    for (int i=1; i<n_threads && (size_t)i<n_dbs; ++i)
+      threads.emplace_back(worker);
+    worker();
+    for (auto &t: threads)
+      t.join();
+
+    for (size_t i=0; i<n_dbs; ++i) {
+        if (errs[i]) {
+            ERR("Error loading cscope database %s", fnames[i]);
+            for (auto db: dbs)
+              delete db;
+            throw(errs[i]);
+        }
     }
 
-    return false;
+    // The merged graph's source sums up the databases it came from
+    CSPhaseTimer timer(CS_PHASE_BUILD);
+    CSDBBuilder builder;
+    CSDBSource src = {0};
+    std::vector<CSDBSource> srcs;
+    std::unordered_set<string> seen;
+
+    for (size_t i=0; i<n_dbs; ++i) {
+        CSDB *db = dbs[i];
+        const CSDBSource &s = db->getSource();
+        const char *base = strrchr(fnames[i], '/');
+        string dir(fnames[i], base ? base - fnames[i] + 1 : 0), name;
+
+        while (!dir.compare(0, 2, "./"))
+          dir.erase(0, 2);
+        for (size_t f=0; f<db->getFileCount(); ++f) {
+            const char *file = db->getFileName(f);
+            name = (file[0] == '/') ? file : dir + file;
+            if (seen.insert(name).second)
+              builder.addFileFrom(db, f, name);
+        }
+        src.size += s.size;
+        if (s.mtime > src.mtime ||
+            (s.mtime == src.mtime && s.mtime_nsec > src.mtime_nsec)) {
+            src.mtime = s.mtime;
+            src.mtime_nsec = s.mtime_nsec;
+        }
+        srcs.push_back(s);
+        delete db;
+    }
+    src.hdr_hash = csHash(srcs.data(), srcs.size() * sizeof(srcs[0]));
+
+    return builder.finish(src);
 }
 
-// Collect all of the callers to 'fn_name'
-static void printCallersRec(
-    FILE       *out,
-    CSDB       *db,
+// The old version loads on a thread of its own while this one loads the new
+// one, the two sharing out 'n_threads'
+void csLoadVersions(
+    const std::vector<const char *> &old_fnames,
+    const std::vector<const char *> &new_fnames,
+    int                              n_threads,
+    bool                             use_snapshot,
+    CSDB                           **old_db,
+    CSDB                           **new_db,
+    size_t                           stream_budget)
+{
+    int old_threads = std::max(1, n_threads / 2);
+    int new_threads = std::max(1, n_threads - old_threads);
+    const char *err = NULL;
+
+    *old_db = *new_db = NULL;
+    std::thread loader([&]() {
+        try {
+            *old_db = csLoadDatabases(old_fnames, old_threads, use_snapshot,
+                                      stream_budget);
+        }
+        catch (const char *e) {
+            err = e;
+        }
+    });
+
+    try {
+        *new_db = csLoadDatabases(new_fnames, new_threads, use_snapshot,
+                                  stream_budget);
+    }
+    catch (...) {
+        loader.join();
+        delete *old_db;
+        *old_db = NULL;
+        throw;
+    }
+    loader.join();
+
+    if (err) {
+        delete *new_db;
+        *new_db = NULL;
+        throw(err);
+    }
+}
+
+bool csIsPattern(const char *fn_name)
+{
+    size_t len = strlen(fn_name);
+    return (len && fn_name[len-1] == '*') ||
+           (len >= 2 && fn_name[0] == '/' && fn_name[len-1] == '/');
+}
+
+// The functions 'fn_name' refers to, in name order: those starting with
+// 'prefix' for "prefix*", those matching 'regex' (anywhere in the name) for
+// "/regex/", and otherwise the function of that name along with its copies
+// in other files.  Regular expressions are matched on 'n_threads' threads,
+// each taking a run of the sorted names.
+std::vector<CSFnId> csFindFunctions(
+    const CSDB *db,
     const char *fn_name,
-    int         depth)
+    int         n_threads)
 {
-    if (depth <= 0)
-      return;
+    std::vector<CSFnId> ids;
+    size_t len = strlen(fn_name);
+    CSFnId id;
+
+    if (!csIsPattern(fn_name)) {
+        CSRange r = db->getPrefix((string(fn_name) + CSDB_COPY_SEP).c_str());
+        if (db->getId(fn_name, &id))
+          ids.push_back(id);
+        ids.insert(ids.end(), r.begin(), r.end());
+        return ids;
+    }
+
+    if (fn_name[len-1] == '*') {
+        CSRange r = db->getPrefix(string(fn_name, len - 1).c_str());
+        ids.assign(r.begin(), r.end());
+        return ids;
+    }
+
+    std::regex re;
+    try {
+        re.assign(fn_name + 1, len - 2, std::regex::ECMAScript);
+    }
+    catch (const std::regex_error &e) {
+        ERR("Invalid regular expression %s: %s", fn_name, e.what());
+        return ids;
+    }
+
+    CSRange all = db->getPrefix("");
+    size_t n_fns = all.size(), per = (n_fns + n_threads - 1) / n_threads;
+    std::vector<std::vector<CSFnId>> matches(n_threads);
+    std::vector<std::thread> threads;
+
+    auto worker = [&](int t) {
+        const std::regex local(re);
+        size_t end = std::min(n_fns, (t + 1) * per);
+        for (size_t i=t*per; i<end; ++i)
+          if (std::regex_search(db->getName(all.begin()[i]), local))
+            matches[t].push_back(all.begin()[i]);
+    };
+
+    for (int t=1; t<n_threads; ++t)
+      threads.emplace_back(worker, t);
+    worker(0);
+    for (auto &t: threads)
+      t.join();
+
+    for (const auto &m: matches)
+      ids.insert(ids.end(), m.begin(), m.end());
+    return ids;
+}
+
+const char *csLimitName(CSLimit limit)
+{
+    switch (limit) {
+    case CS_LIMIT_EDGES: return "edge limit";
+    case CS_LIMIT_NODES: return "node limit";
+    case CS_LIMIT_TIMEOUT: return "timeout";
+    case CS_LIMIT_CANCEL: return "cancelled";
+    default: return NULL;
+    }
+}
+
+// Keeps a query to its CSLimits.  The clock and the cancel flag are only
+// looked at every CS_LIMIT_CHECK_STEPS steps, so that checking is cheap.
+class CSBudget
+{
+public:
+    CSBudget(const CSLimits *limits) :
+        _max_edges(SIZE_MAX), _max_nodes(SIZE_MAX), _timeout_ms(0),
+        _cancel(NULL), _top(0), _countdown(CS_LIMIT_CHECK_STEPS)
+    {
+        if (limits) {
+            if (limits->max_edges)
+              this->_max_edges = limits->max_edges;
+            if (limits->max_nodes)
+              this->_max_nodes = limits->max_nodes;
+            this->_timeout_ms = limits->timeout_ms;
+            this->_cancel = limits->cancel;
+            this->_top = limits->top;
+        }
+        if (this->_timeout_ms) {
+            clock_gettime(CLOCK_MONOTONIC, &this->_deadline);
+            this->_deadline.tv_sec += this->_timeout_ms / 1000;
+            this->_deadline.tv_nsec += (this->_timeout_ms % 1000) * 1000000;
+            if (this->_deadline.tv_nsec >= 1000000000) {
+                ++this->_deadline.tv_sec;
+                this->_deadline.tv_nsec -= 1000000000;
+            }
+        }
+    }
+
+    // Take a step: has the query run out of time or been cancelled?
+    CSLimit step() {
+        if (--this->_countdown)
+          return CS_LIMIT_NONE;
+        this->_countdown = CS_LIMIT_CHECK_STEPS;
+        return check();
+    }
+
+    // Is there no room for another edge (or function) in the result?
+    bool edgesFull(size_t n_edges) const {
+        return n_edges >= this->_max_edges;
+    }
+    bool nodesFull(size_t n_nodes) const {
+        return n_nodes >= this->_max_nodes;
+    }
+    size_t nodesLeft(size_t n_nodes) const {
+        return n_nodes < this->_max_nodes ? this->_max_nodes - n_nodes : 0;
+    }
+
+    // The neighbours of 'fn' to follow: all of them, or the top ranked.
+    // They come in rank order whenever there is a node budget, so that it
+    // is the most connected functions that make it in.
+    CSRange neighbours(const CSDB *db, CSFnId fn, bool callers) const {
+        if (!this->_top && this->_max_nodes == SIZE_MAX)
+          return callers ? db->getCallers(fn) : db->getCallees(fn);
+
+        CSRange r = callers ? db->getCallersRanked(fn) :
+                              db->getCalleesRanked(fn);
+        if (this->_top && r.size() > this->_top)
+          r.last = r.first + this->_top;
+        return r;
+    }
+
+private:
+    size_t                   _max_edges;
+    size_t                   _max_nodes;
+    long                     _timeout_ms;
+    const std::atomic<bool> *_cancel;
+    size_t                   _top;
+    struct timespec          _deadline;
+    unsigned                 _countdown;
+
+    CSLimit check() const {
+        struct timespec now;
+
+        if (this->_cancel && this->_cancel->load(std::memory_order_relaxed))
+          return CS_LIMIT_CANCEL;
+        if (this->_timeout_ms) {
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            if (now.tv_sec > this->_deadline.tv_sec ||
+                (now.tv_sec == this->_deadline.tv_sec &&
+                 now.tv_nsec >= this->_deadline.tv_nsec))
+              return CS_LIMIT_TIMEOUT;
+        }
+        return CS_LIMIT_NONE;
+    }
+};
+
+// Walk the callers (or callees) of 'roots' breadth first, one level at a
+// time, 'depth' levels deep (0: until everything reachable has been seen),
+// collecting the edges followed.  All of the roots start in the first level.
+// Each function is expanded at most once, so every edge is collected once
+// and cycles do not matter.  Stops at the first of 'limits' reached,
+// returning it, and follows only the top ranked neighbours if it says so.
+static CSLimit findEdges(
+    const CSDB                *db,
+    const std::vector<CSFnId> &roots,
+    int                        depth,
+    bool                       callers,
+    CSEdgeList                &edges,
+    const CSLimits            *limits)
+{
+    CSPhaseTimer timer(CS_PHASE_TRAVERSAL);
+    CSBudget budget(limits);
+    CSLimit stop;
+    std::vector<bool> seen(db->getFunctionCount());
+    std::vector<CSFnId> frontier, next;
+    size_t n_nodes = 0;
+
+    for (auto fn: roots) {
+        if (!seen[fn]) {
+            if (budget.nodesFull(n_nodes))
+              return CS_LIMIT_NODES;
+            seen[fn] = true;
+            ++n_nodes;
+            frontier.push_back(fn);
+        }
+    }
+    for (int level=0; (depth == 0 || level < depth) && !frontier.empty();
+         ++level) {
+        next.clear();
+        for (auto f: frontier) {
+            for (auto g: budget.neighbours(db, f, callers)) {
+                if ((stop = budget.step()))
+                  return stop;
+                if (budget.edgesFull(edges.size()))
+                  return CS_LIMIT_EDGES;
+                if (!seen[g] && budget.nodesFull(n_nodes))
+                  return CS_LIMIT_NODES;
+                edges.push_back(callers ? std::make_pair(g, f) :
+                                          std::make_pair(f, g));
+                if (!seen[g]) {
+                    seen[g] = true;
+                    ++n_nodes;
+                    next.push_back(g);
+                }
+            }
+        }
+        frontier.swap(next);
+    }
+
+    return CS_LIMIT_NONE;
+}
+
+CSLimit csFindCallers(
+    const CSDB                *db,
+    const std::vector<CSFnId> &roots,
+    int                        depth,
+    CSEdgeList                &edges,
+    const CSLimits            *limits)
+{
+    return findEdges(db, roots, depth, true, edges, limits);
+}
+
+CSLimit csFindCallees(
+    const CSDB                *db,
+    const std::vector<CSFnId> &roots,
+    int                        depth,
+    CSEdgeList                &edges,
+    const CSLimits            *limits)
+{
+    return findEdges(db, roots, depth, false, edges, limits);
+}
+
+void csCollapseEdges(
+    const CSDB               *db,
+    const CSEdgeList         &edges,
+    CSCollapse                how,
+    std::vector<std::string> &names,
+    CSEdgeList               &grouped)
+{
+    std::vector<uint32_t> group(db->getFunctionCount(), UINT32_MAX);
+    std::unordered_map<string, uint32_t> ids;
+    std::unordered_set<uint64_t> seen;
+
+    names.clear();
+    grouped.clear();
+    auto groupOf = [&](CSFnId fn) {
+        if (group[fn] != UINT32_MAX)
+          return group[fn];
+
+        uint32_t f = db->getFunctionFile(fn);
+        string name;
+        if (how == CS_COLLAPSE_NONE || f == CSDB_NO_FILE)
+          name = db->getName(fn);
+        else {
+            name = db->getFileName(f);
+            if (how == CS_COLLAPSE_DIR) {
+                size_t slash = name.rfind('/');
+                name = slash == string::npos ? "." : name.substr(0, slash);
+            }
+        }
+
+        auto it = ids.emplace(name, names.size());
+        if (it.second)
+          names.push_back(name);
+        return group[fn] = it.first->second;
+    };
+
+    for (const auto &e: edges) {
+        uint32_t from = groupOf(e.first), to = groupOf(e.second);
+        if (from != to && seen.insert((uint64_t)from << 32 | to).second)
+          grouped.push_back(std::make_pair(from, to));
+    }
+}
+
+// Write the graph 'title' of 'edges' that a query stopped by 'stop' found,
+// collapsed as 'collapse' says or with call 'counts'
+static void printGraph(
+    FILE             *out,
+    CSFormat          format,
+    const CSDB       *db,
+    const string     &title,
+    const CSEdgeList &edges,
+    CSLimit           stop,
+    CSCollapse        collapse,
+    bool              counts)
+{
+    if (collapse == CS_COLLAPSE_NONE) {
+        csEmitGraph(out, format, db, title.c_str(), edges,
+                    std::vector<CSFnId>(), csLimitName(stop), counts);
+        return;
+    }
+
+    std::vector<std::string> names;
+    CSEdgeList grouped;
+    {
+        CSPhaseTimer timer(CS_PHASE_TRAVERSAL);
+        csCollapseEdges(db, edges, collapse, names, grouped);
+    }
+    csEmitNamedGraph(out, format,
+                     (title + (collapse == CS_COLLAPSE_FILE ?
+                               " by file" : " by directory")).c_str(),
+                     names, grouped, csLimitName(stop));
+}
+
+CSLimit csPrintCallers(
+    FILE           *out,
+    const CSDB     *db,
+    const char     *fn_name,
+    int             depth,
+    int             n_threads,
+    CSFormat        format,
+    const CSLimits *limits,
+    CSCollapse      collapse,
+    bool            counts)
+{
+    CSEdgeList edges;
+    CSLimit stop = csFindCallers(db, csFindFunctions(db, fn_name, n_threads),
+                                 depth, edges, limits);
+    printGraph(out, format, db, string("Callers to ") + fn_name, edges, stop,
+               collapse, counts);
+    return stop;
+}
+
+CSLimit csPrintCallees(
+    FILE           *out,
+    const CSDB     *db,
+    const char     *fn_name,
+    int             depth,
+    int             n_threads,
+    CSFormat        format,
+    const CSLimits *limits,
+    CSCollapse      collapse,
+    bool            counts)
+{
+    CSEdgeList edges;
+    CSLimit stop = csFindCallees(db, csFindFunctions(db, fn_name, n_threads),
+                                 depth, edges, limits);
+    printGraph(out, format, db, string("Callees of ") + fn_name, edges, stop,
+               collapse, counts);
+    return stop;
+}
+
+// Find every function that 'roots' call (or that call them) directly or
+// not, in name order.  Rather than following calls, this walks the
+// condensed graph: each component reached contributes all of its functions,
+// and is expanded once over its distinct callee (or caller) components.  A
+// root is included only if it reaches itself, through recursion or a cycle.
+// Stops at the first of 'limits' reached (max_edges does not apply),
+// returning it.
+CSLimit csFindReach(
+    const CSDB                *db,
+    const std::vector<CSFnId> &roots,
+    bool                       callers,
+    std::vector<CSFnId>       &fns,
+    const CSLimits            *limits)
+{
+    CSBudget budget(limits);
+    CSLimit stop;
+    std::vector<bool> seen(db->getSccCount());
+    std::vector<CSSccId> stack;
+
+    fns.clear();
+    {
+        CSPhaseTimer timer(CS_PHASE_TRAVERSAL);
+        auto expand = [&](CSSccId c) {
+            CSLimit stop;
+            for (auto next: callers ? db->getSccCallers(c) :
+                                      db->getSccCallees(c)) {
+                if ((stop = budget.step()))
+                  return stop;
+                if (!seen[next]) {
+                    seen[next] = true;
+                    stack.push_back(next);
+                }
+            }
+            return CS_LIMIT_NONE;
+        };
+
+        // Add a component's functions, as many as there is room for
+        auto take = [&](CSRange members) {
+            size_t n = std::min(members.size(), budget.nodesLeft(fns.size()));
+            fns.insert(fns.end(), members.begin(), members.begin() + n);
+            return n < members.size() ? CS_LIMIT_NODES : CS_LIMIT_NONE;
+        };
+
+        auto walk = [&]() {
+            CSLimit stop;
+            for (auto fn: roots)
+              if ((stop = expand(db->getScc(fn))))
+                return stop;
+            while (!stack.empty()) {
+                CSSccId c = stack.back();
+                stack.pop_back();
+                if ((stop = take(db->getSccFunctions(c))) ||
+                    (stop = expand(c)))
+                  return stop;
+            }
+
+            // Roots' own components, unless reached from another root's
+            for (auto fn: roots) {
+                CSSccId c = db->getScc(fn);
+                if (seen[c])
+                  continue;
+                seen[c] = true;
+                auto members = db->getSccFunctions(c);
+                auto calls = db->getCallees(members.first[0]);
+                if ((members.size() > 1 ||
+                     std::find(calls.begin(), calls.end(), members.first[0]) !=
+                     calls.end()) &&
+                    (stop = take(members)))
+                  return stop;
+            }
+            return CS_LIMIT_NONE;
+        };
+
+        stop = walk();
+
+        // Large results are quicker to pick out of the name-sorted ids
+        // than to sort
+        if (fns.size() > db->getFunctionCount() / 16) {
+            std::vector<bool> found(db->getFunctionCount());
+            for (auto fn: fns)
+              found[fn] = true;
+            fns.clear();
+            for (auto fn: db->getPrefix(""))
+              if (found[fn])
+                fns.push_back(fn);
+        }
+        else
+          std::sort(fns.begin(), fns.end(), [db](CSFnId a, CSFnId b) {
+              return strcmp(db->getName(a), db->getName(b)) < 0;
+          });
+    }
+
+    return stop;
+}
+
+// List the functions csFindReach finds for 'fn_name', a name per line
+CSLimit csPrintReach(
+    FILE           *out,
+    const CSDB     *db,
+    const char     *fn_name,
+    bool            callers,
+    int             n_threads,
+    const CSLimits *limits)
+{
+    std::vector<CSFnId> fns;
+    CSLimit stop = csFindReach(db, csFindFunctions(db, fn_name, n_threads),
+                               callers, fns, limits);
+
+    CSPhaseTimer timer(CS_PHASE_OUTPUT);
+    for (auto fn: fns)
+      fprintf(out, "%s\n", db->getName(fn));
+    if (stop)
+      fprintf(out, "... (truncated: %s)\n", csLimitName(stop));
+    return stop;
+}
+
+// Find every shortest call path from 'from' to 'to', returning the edges
+// they use in 'edges' (nearest 'from' first).  Searches forwards over callees
+// from 'from' and backwards over callers from 'to', a level at a time and
+// always on the side with the smaller frontier, until the two searches meet.
+// Returns false if 'to' cannot be reached.
+bool csFindPaths(
+    const CSDB *db,
+    CSFnId      from,
+    CSFnId      to,
+    CSEdgeList &edges)
+{
+    const size_t n_fns = db->getFunctionCount();
+    std::vector<int> dist[2] = {std::vector<int>(n_fns, -1),
+                                std::vector<int>(n_fns, -1)};
+    std::vector<std::vector<CSFnId>> levels[2]; // Functions at each distance
+    std::vector<CSFnId> meet;
+    std::vector<bool> on_path(n_fns);
+
+    // Side 0 searches from 'from' over callees, side 1 from 'to' over callers
+    dist[0][from] = dist[1][to] = 0;
+    levels[0].push_back(std::vector<CSFnId>(1, from));
+    levels[1].push_back(std::vector<CSFnId>(1, to));
+    if (from == to)
+      return true;
+
+    // Once every path of length up to the sum of the two depths has been
+    // seen, the first functions labelled by both sides all lie on shortest
+    // paths, at the same distance from each end.
+    while (meet.empty()) {
+        int side = levels[0].back().size() <= levels[1].back().size() ? 0 : 1;
+        int d = levels[side].size();
+        std::vector<CSFnId> next;
+
+        for (auto f: levels[side][d-1]) {
+            for (auto g: side == 0 ? db->getCallees(f) : db->getCallers(f)) {
+                if (dist[side][g] != -1)
+                  continue;
+                dist[side][g] = d;
+                next.push_back(g);
+                if (dist[!side][g] != -1)
+                  meet.push_back(g);
+            }
+        }
 
-    for (auto pr: *db) {
-        const char *item = pr.first.c_str();
-        // Does 'item' call 'fn_name' ?
-        if (isCallerOf(db, item, fn_name)) {
-            fprintf(out, "    %s -> %s\n", item, fn_name);
-            printCallersRec(out, db, item, depth - 1);
+        if (next.empty())
+          return false;
+        levels[side].push_back(std::move(next));
+    }
+
+    // Walk back from the meeting functions towards each end, keeping the
+    // edges that stay on a shortest path.
+    std::vector<std::pair<CSFnId, CSFnId>> to_from, to_to;
+    for (auto m: meet)
+      on_path[m] = true;
+    for (int k=(int)levels[0].size()-2; k>=0; --k) {
+        for (auto f: levels[0][k]) {
+            for (auto g: db->getCallees(f)) {
+                if (on_path[g] && dist[0][g] == k + 1) {
+                    to_from.push_back(std::make_pair(f, g));
+                    on_path[f] = true;
+                }
+            }
         }
     }
+    for (int k=(int)levels[1].size()-2; k>=0; --k) {
+        for (auto f: levels[1][k]) {
+            for (auto g: db->getCallers(f)) {
+                if (on_path[g] && dist[1][g] == k + 1) {
+                    to_to.push_back(std::make_pair(g, f));
+                    on_path[f] = true;
+                }
+            }
+        }
+    }
+
+    edges.assign(to_from.rbegin(), to_from.rend());
+    edges.insert(edges.end(), to_to.begin(), to_to.end());
+    return true;
 }
 
-void csPrintCallers(FILE *out, CSDB *db, const char *fn_name, int depth)
+// Print each path from 'fn' to 'to' over 'next' (every one of which reaches
+// 'to') as text, up to a total of CS_MAX_PATHS.  Counting stops one past
+// that, so the caller can tell whether any were left out.
+static void printPathsRec(
+    FILE                                                *out,
+    const CSDB                                          *db,
+    CSFnId                                               fn,
+    CSFnId                                               to,
+    const std::unordered_map<CSFnId, std::vector<CSFnId>> &next,
+    std::vector<CSFnId>                                 &path,
+    size_t                                              *n_paths)
 {
-    cout << "Building callers... " << std::flush;
-    fprintf(out, "digraph \"Callers to %s\" {\n", fn_name);
-    printCallersRec(out, db, fn_name, depth);
-    fprintf(out, "}\n");
-    cout << "Done" << endl;
+    path.push_back(fn);
+    if (fn == to) {
+        if ((*n_paths)++ < CS_MAX_PATHS) {
+            for (size_t i=0; i<path.size(); ++i)
+              fprintf(out, "%s%s", i ? " -> " : "", db->getName(path[i]));
+            fputc('\n', out);
+        }
+    }
+    else {
+        for (auto g: next.at(fn)) {
+            if (*n_paths > CS_MAX_PATHS)
+              break;
+            printPathsRec(out, db, g, to, next, path, n_paths);
+        }
+    }
+    path.pop_back();
 }
 
-// Collect all of the callees to 'fn_name'
-static void printCalleesRec(
+bool csPrintPaths(
     FILE       *out,
-    CSDB       *db,
-    const char *fn_name,
-    int         depth)
+    const CSDB *db,
+    const char *from_name,
+    const char *to_name,
+    bool        text,
+    CSFormat    format)
 {
-    if (depth <= 0)
-      return;
+    CSFnId from, to;
+    bool found = false;
+    CSEdgeList edges;
+
+    if (db->getId(from_name, &from) && db->getId(to_name, &to)) {
+        CSPhaseTimer timer(CS_PHASE_TRAVERSAL);
+        found = csFindPaths(db, from, to, edges);
+    }
+
+    if (text) {
+        CSPhaseTimer timer(CS_PHASE_OUTPUT);
+        if (found) {
+            std::unordered_map<CSFnId, std::vector<CSFnId>> next;
+            std::vector<CSFnId> path;
+            size_t n_paths = 0;
+
+            for (const auto &e: edges)
+              next[e.first].push_back(e.second);
+            printPathsRec(out, db, from, to, next, path, &n_paths);
+            if (n_paths > CS_MAX_PATHS)
+              fprintf(out, "... (more than %d paths)\n", CS_MAX_PATHS);
+        }
+        return found;
+    }
+
+    // A function is its own (empty) path
+    std::vector<CSFnId> nodes;
+    if (found && from == to)
+      nodes.push_back(from);
+    csEmitGraph(out, format, db,
+                (string("Paths from ") + from_name + " to " + to_name).c_str(),
+                edges, nodes);
+    return found;
+}
+
+// Line up the functions of 'a' and 'b' by walking both in name order.
+// 'a_to_b' gets the id in 'b' of each function of 'a', or UINT32_MAX if 'b'
+// has none of that name, and 'b_to_a' the reverse.
+static void matchFunctions(
+    const CSDB          *a,
+    const CSDB          *b,
+    std::vector<CSFnId> &a_to_b,
+    std::vector<CSFnId> &b_to_a)
+{
+    CSRange ra = a->getPrefix(""), rb = b->getPrefix("");
+    const CSFnId *i = ra.begin(), *j = rb.begin();
+
+    a_to_b.assign(a->getFunctionCount(), UINT32_MAX);
+    b_to_a.assign(b->getFunctionCount(), UINT32_MAX);
+    while (i != ra.end() && j != rb.end()) {
+        int cmp = strcmp(a->getName(*i), b->getName(*j));
+        if (cmp < 0)
+          ++i;
+        else if (cmp > 0)
+          ++j;
+        else {
+            a_to_b[*i] = *j;
+            b_to_a[*j] = *i;
+            ++i;
+            ++j;
+        }
+    }
+}
+
+// Collect the functions and calls of 'to' that 'from' does not have.  For
+// each caller, 'mark' flags (with the caller's id) the callees it is known
+// to have already, so that each call is checked in constant time.
+static void diffCalls(
+    const CSDB                *from,
+    const CSDB                *to,
+    const std::vector<CSFnId> &from_to,
+    const std::vector<CSFnId> &to_from,
+    CSEdgeList                &calls,
+    std::vector<CSFnId>       &fns)
+{
+    std::vector<CSFnId> mark(to->getFunctionCount(), UINT32_MAX);
+
+    for (CSFnId fn=0; fn<to->getFunctionCount(); ++fn) {
+        if (to_from[fn] == UINT32_MAX)
+          fns.push_back(fn);
+        else {
+            for (auto g: from->getCallees(to_from[fn])) {
+                if (from_to[g] != UINT32_MAX)
+                  mark[from_to[g]] = fn;
+            }
+        }
+        for (auto g: to->getCallees(fn)) {
+            if (mark[g] != fn) {
+                mark[g] = fn;
+                calls.push_back(std::make_pair(fn, g));
+            }
+        }
+    }
+}
+
+// The added and the removed half are independent, so with 'n_threads' they
+// are found at the same time
+void csFindDiff(
+    const CSDB *old_db,
+    const CSDB *new_db,
+    CSDiff     &diff,
+    int         n_threads)
+{
+    CSPhaseTimer timer(CS_PHASE_TRAVERSAL);
+    std::vector<CSFnId> old_to_new, new_to_old;
+
+    diff = CSDiff();
+    matchFunctions(old_db, new_db, old_to_new, new_to_old);
+
+    auto removed = [&]() {
+        diffCalls(new_db, old_db, new_to_old, old_to_new, diff.removed,
+                  diff.removed_fns);
+    };
+    std::thread t;
+    if (n_threads > 1)
+      t = std::thread(removed);
+    diffCalls(old_db, new_db, old_to_new, new_to_old, diff.added,
+              diff.added_fns);
+    if (t.joinable())
+      t.join();
+    else
+      removed();
+}
+
+// Narrow 'calls' down to those a query 'found', in the order it found them,
+// and 'fns' down to the functions at either end of one
+static void keepCalls(
+    CSEdgeList          &calls,
+    std::vector<CSFnId> &fns,
+    const CSEdgeList    &found)
+{
+    std::unordered_set<uint64_t> changed;
+    std::unordered_set<CSFnId> ends;
+    CSEdgeList kept;
+
+    for (const auto &e: calls)
+      changed.insert((uint64_t)e.first << 32 | e.second);
+    for (const auto &e: found) {
+        if (changed.erase((uint64_t)e.first << 32 | e.second)) {
+            kept.push_back(e);
+            ends.insert(e.first);
+            ends.insert(e.second);
+        }
+    }
+
+    calls.swap(kept);
+    fns.erase(std::remove_if(fns.begin(), fns.end(),
+                             [&](CSFnId fn) { return !ends.count(fn); }),
+              fns.end());
+}
+
+// Print what changed from 'old_db' to 'new_db'.  With 'fn_name', only the
+// changes among its callers (or callees) 'depth' deep are printed: the added
+// calls that the query finds in the new graph and the removed calls that it
+// finds in the old one.  Returns the limit that cut either query short.
+CSLimit csPrintDiff(
+    FILE           *out,
+    const CSDB     *old_db,
+    const CSDB     *new_db,
+    const char     *fn_name,
+    int             depth,
+    bool            callers,
+    int             n_threads,
+    const CSLimits *limits)
+{
+    CSDiff diff;
+    CSEdgeList old_edges, new_edges;
+    CSLimit stop, old_stop;
+
+    csFindDiff(old_db, new_db, diff, n_threads);
+    if (!fn_name) {
+        csEmitDiff(out, "Changed calls", old_db, new_db, diff);
+        return CS_LIMIT_NONE;
+    }
+
+    stop = findEdges(new_db, csFindFunctions(new_db, fn_name, n_threads),
+                     depth, callers, new_edges, limits);
+    old_stop = findEdges(old_db, csFindFunctions(old_db, fn_name, n_threads),
+                         depth, callers, old_edges, limits);
+    if (!stop)
+      stop = old_stop;
+    {
+        CSPhaseTimer timer(CS_PHASE_TRAVERSAL);
+        keepCalls(diff.added, diff.added_fns, new_edges);
+        keepCalls(diff.removed, diff.removed_fns, old_edges);
+    }
+
+    string title = string(callers ? "Changed callers to " :
+                                    "Changed callees of ") + fn_name;
+    csEmitDiff(out, title.c_str(), old_db, new_db, diff, csLimitName(stop));
+    return stop;
+}
+
+// The name of the file in which to write the graphs of 'fn'.  Patterns can
+// hold a '/' (and anything else), so '%', '/' and control characters are
+// written as %XX.
+static std::string fileName(const char *fn)
+{
+    static const char hex[] = "0123456789ABCDEF";
+    std::string name;
+
+    for (const char *c = fn; *c; ++c) {
+        unsigned char ch = *c;
+        if (ch == '%' || ch == '/' || ch < 0x20 || ch == 0x7f) {
+            name += '%';
+            name += hex[ch >> 4];
+            name += hex[ch & 0xf];
+        }
+        else
+          name += ch;
+    }
+    return name;
+}
+
+// Print the callers and/or callees of every function in 'fn_names', running
+// the queries on 'n_threads' threads.  With 'out_dir' each function gets its
+// own out_dir/<fn>.dot (or the extension of 'format'), otherwise everything
+// goes to 'out' in the order of 'fn_names'.  Returns false if an output file
+// could not be written.
+bool csPrintBatch(
+    FILE                           *out,
+    const char                     *out_dir,
+    const CSDB                     *db,
+    const std::vector<std::string> &fn_names,
+    int                             depth,
+    bool                            callers,
+    bool                            callees,
+    int                             n_threads,
+    CSFormat                        format,
+    const CSLimits                 *limits,
+    CSCollapse                      collapse,
+    bool                            counts)
+{
+    const size_t n_fns = fn_names.size();
+    std::atomic<size_t> next_fn(0);
+    std::atomic<bool> ok(true);
+    std::mutex lock;
+    std::vector<char *> bufs(n_fns, NULL); // Finished, but not yet written
+    std::vector<size_t> lens(n_fns);
+    std::vector<bool> done(n_fns);
+    size_t next_out = 0;
+
+    auto print = [&](FILE *fp, const char *fn) {
+        if (callers)
+          csPrintCallers(fp, db, fn, depth, 1, format, limits, collapse,
+                         counts);
+        if (callees)
+          csPrintCallees(fp, db, fn, depth, 1, format, limits, collapse,
+                         counts);
+    };
+
+    auto worker = [&]() {
+        size_t i;
+        while ((i = next_fn++) < n_fns) {
+            const char *fn = fn_names[i].c_str();
+            FILE *fp;
+
+            if (out_dir) {
+                std::string path = std::string(out_dir) + "/" +
+                                   fileName(fn) + csFormatExt(format);
+                if (!(fp = fopen(path.c_str(), "w"))) {
+                    ERR("Error opening output file %s for %s: %s",
+                        path.c_str(), fn, strerror(errno));
+                    ok = false;
+                    continue;
+                }
+                print(fp, fn);
+                if (fclose(fp)) {
+                    ERR("Error writing output file %s for %s: %s",
+                        path.c_str(), fn, strerror(errno));
+                    ok = false;
+                }
+                continue;
+            }
+
+            // Render in memory, then write out whatever is next in order
+            char *buf = NULL;
+            size_t len = 0;
+            if ((fp = open_memstream(&buf, &len))) {
+                print(fp, fn);
+                fclose(fp);
+            }
+            else {
+                ERR("Could not allocate output for %s", fn);
+                ok = false;
+            }
+
+            std::lock_guard<std::mutex> guard(lock);
+            bufs[i] = buf;
+            lens[i] = len;
+            done[i] = true;
+            for ( ; next_out < n_fns && done[next_out]; ++next_out) {
+                fwrite(bufs[next_out], 1, lens[next_out], out);
+                free(bufs[next_out]);
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int i=1; i<n_threads; ++i)
+      threads.emplace_back(worker);
+    worker();
+    for (auto &t: threads)
+      t.join();
+
+    return ok && !ferror(out);
+}
+
+// Parse the file section containing database offset 'off', unless it has
+// been already.  Returns the section's file, or NULL for offsets outside of
+// the symbol data.
+CSFile *CS::loadSectionAt(size_t off)
+{
+    const uint8_t *first = this->_data + this->_hdr.syms_start, *c;
+    size_t start, end = std::min(this->_hdr.trailer, this->_data_len);
+
+    if (off < this->_hdr.syms_start || off >= end)
+      return NULL;
+
+    // Back up to the section's "\t@<file>" line
+    for (c = this->_data + off + 1; ; ) {
+        c = (const uint8_t *)memrchr(first, '@', c - first);
+        if (!c || c == first)
+          return NULL;
+        if (c[-1] == '\t' && (c - 1 == first || c[-2] == '\n'))
+          break;
+    }
+    start = c - 1 - this->_data;
+
+    auto it = this->_sections.find(start);
+    if (it != this->_sections.end())
+      return it->second;
+
+    // The section ends at the next file mark
+    for (++c; c < this->_data + end; ++c) {
+        if (!(c = (const uint8_t *)memchr(c, '@', this->_data + end - c)))
+          break;
+        if (c[-1] == '\t' && c[-2] == '\n') {
+            end = c - 1 - this->_data;
+            break;
+        }
+    }
+
+    auto file = loadFileSection(this->_data, start, end,
+                                this->_hdr.compression);
+    this->_sections[start] = file;
+    return file;
+}
+
+// Does 'fndef' call 'name'? (For names not interned in fndef's file)
+static bool callsName(const CSFuncDef *fndef, std::string_view name)
+{
+    for (auto c = fndef->getCallees(); c; c = c->getNext())
+      if (c->getName() == name)
+        return true;
+    return false;
+}
+
+// Parse the sections that the index says contain 'term' with 'mark' (a
+// definition or a call), and return their files in 'files'.
+bool CS::loadPostings(
+    const CSInvIndex      *inv,
+    const string          &term,
+    char                   mark,
+    std::vector<CSFile *> &files)
+{
+    std::vector<CSInvPosting> postings;
+
+    files.clear();
+    if (!inv->find(term.c_str(), postings))
+      return false;
+
+    for (auto &p: postings) {
+        if (p.type != mark)
+          continue;
+
+        auto file = loadSectionAt(p.lineoffset);
+        if (!file)
+          return false;
+        if (std::find(files.begin(), files.end(), file) == files.end())
+          files.push_back(file);
+    }
+
+    // Trust, but verify: each file must really mention 'term'
+    for (auto file: files) {
+        bool found = false;
+        for (auto fndef = file->getFunctions(); fndef && !found;
+             fndef = fndef->getNext()) {
+            if (mark == CS_FN_DEF)
+              found = fndef->getName() == term;
+            else
+              found = callsName(fndef, term);
+        }
+        if (!found)
+          return false;
+    }
+
+    return true;
+}
+
+bool CS::loadNeighbourhood(
+    const CSInvIndex *inv,
+    const char       *fn_name,
+    int               depth,
+    bool              callers,
+    bool              callees)
+{
+    CSPhaseTimer timer(CS_PHASE_PARSE);
+    std::vector<CSFile *> files, def_files;
+
+    // Every function in the graph has all of its definitions loaded: which
+    // of them are static decides the one that each call goes to (see
+    // CSDBBuilder).  Expanding callees loads them, as does finding callers.
+    if (callers && !loadPostings(inv, fn_name, CS_FN_DEF, def_files))
+      return false;
+
+    for (int dir=0; dir<2; ++dir) {
+        bool to_callers = (dir == 0);
+        if ((to_callers && !callers) || (!to_callers && !callees))
+          continue;
+
+        std::vector<string> frontier(1, fn_name), next;
+        std::unordered_map<string, bool> seen;
+        seen[fn_name] = true;
+
+        for (int level=0; (depth == 0 || level < depth) && !frontier.empty();
+             ++level) {
+            next.clear();
+            for (auto &name: frontier) {
+                // Callees come from the definitions of 'name'
+                if (!to_callers) {
+                    if (!loadPostings(inv, name, CS_FN_DEF, files))
+                      return false;
+                    for (auto file: files)
+                      for (auto d = file->getFunctions(); d; d = d->getNext()) {
+                          if (d->getName() != name)
+                            continue;
+                          for (auto c = d->getCallees(); c; c = c->getNext())
+                            if (!seen[string(c->getName())]) {
+                                seen[string(c->getName())] = true;
+                                next.push_back(string(c->getName()));
+                            }
+                      }
+                    continue;
+                }
+
+                // Callers are the definitions that call 'name'
+                if (!loadPostings(inv, name, CS_FN_CALL, files))
+                  return false;
+                for (auto file: files)
+                  for (auto d = file->getFunctions(); d; d = d->getNext()) {
+                      string caller(d->getName());
+                      if (seen[caller] || !callsName(d, name))
+                        continue;
+                      if (!loadPostings(inv, caller, CS_FN_DEF, def_files))
+                        return false;
+                      seen[caller] = true;
+                      next.push_back(caller);
+                  }
+            }
+            frontier.swap(next);
+        }
+
+        // The callees left unexpanded still need their definitions
+        if (!to_callers)
+          for (auto &name: frontier)
+            if (!loadPostings(inv, name, CS_FN_DEF, def_files))
+              return false;
+    }
 
-    for (auto callee: (*db)[fn_name]) {
-        fprintf(out, "    %s -> %s\n", fn_name, callee->getName().c_str());
-        printCalleesRec(out, db, callee->getName().c_str(), depth - 1);
+    // Build from the sections in database order, as a full load would
+    for (auto pr: this->_sections) {
+        if (pr.second->getName().size() == 0) {
+            delete pr.second;
+            continue;
+        }
+        this->addFile(pr.second);
+        this->_n_functions += pr.second->getFunctionCount();
     }
+    this->_sections.clear();
+
+    return true;
 }
 
-void csPrintCallees(FILE *out, CSDB *db, const char *fn_name, int depth)
+// Load just enough of cscope database 'fname' to answer a 'depth' deep
+// callers and/or callees query of 'fn_name', using the inverted index built
+// by cscope -q.  Returns NULL if there is no usable index.
+CSDB *csLoadNeighbourhood(
+    const char *fname,
+    const char *fn_name,
+    int         depth,
+    bool        callers,
+    bool        callees)
 {
-    cout << "Building callees... " << std::flush;
-    fprintf(out, "digraph \"Callees of %s\" {\n", fn_name);
-    printCalleesRec(out, db, fn_name, depth);
-    fprintf(out, "}\n");
-    cout << "Done" << endl;
+    CSDB *db = NULL;
+    CSInvIndex *inv;
+
+    if (!(inv = CSInvIndex::open(fname)))
+      return NULL;
+
+    CS cs(fname, 1, NULL, false);
+    if (!cs.hasInvertedIndex())
+      ; // Leftover index files of an older database
+    else if (cs.loadNeighbourhood(inv, fn_name, depth, callers, callees))
+      db = cs.buildDatabase();
+    else
+      ERR("Ignoring inconsistent inverted index for %s", fname);
+
+    delete inv;
+    return db;
 }
 
 // Header looks like:
 //     <cscope> <dir> <version> [-c] [-q <symbols>] [-T] <trailer>
 void CS::initHeader(const uint8_t *data, size_t data_len)
 {
+    CSPhaseTimer timer(CS_PHASE_HEADER);
     pos_t pos = {0};
-    char buf[1024], *tok;
+    char *tok;
 
     pos.data = data;
     pos.data_len = data_len;
-    getLine(&pos, buf, sizeof(buf));
+    std::string buf(getLine(&pos));
+    cs_stats.bytes_scanned += pos.off;
 
     // After the header are the symbols
     this->_hdr.syms_start = pos.off;
 
     // Load in the header: <cscope>
-    tok = strtok(buf, " ");
-    if (strncmp(tok, "cscope", strlen("cscope"))) {
+    tok = strtok(&buf[0], " ");
+    if (!tok || strncmp(tok, "cscope", strlen("cscope"))) {
         ERR("This does not appear to be a cscope database");
         return;
     }
 
     // Version
-    this->_hdr.version = atoi(strtok(NULL, " "));
+    if (!(tok = strtok(NULL, " "))) {
+        ERR("Truncated cscope header");
+        return;
+    }
+    this->_hdr.version = atoi(tok);
 
     // Directory
-    this->_hdr.dir = strndup(strtok(NULL, " "), 1024);
+    if (!(tok = strtok(NULL, " "))) {
+        ERR("Truncated cscope header");
+        return;
+    }
+    this->_hdr.dir = strndup(tok, 1024);
 
     // Optionals: [-c] [-T] [-q <syms>]
+    // The database is compressed unless -c (ASCII only) was used.
+    this->_hdr.compression = true;
     while ((tok = strtok(NULL, " "))) {
         if (tok[0] == '-' && strlen(tok) == 2) {
             if (tok[1] == 'c')
-              this->_hdr.compression = true;
+              this->_hdr.compression = false;
             else if (tok[1] == 'T')
               this->_hdr.prefix_match = true;
-            else if (tok[1] == 'q')
-              this->_hdr.inverted_index = true; // TODO
+            else if (tok[1] == 'q') {
+                // -q is followed by the number of terms in the index
+                this->_hdr.inverted_index = true;
+                strtok(NULL, " ");
+            }
             else {
                 ERR("Unrecognized header option");
                 return;
@@ -372,8 +1855,9 @@ void CS::initHeader(const uint8_t *data, size_t data_len)
 
 void CS::initTrailer(const uint8_t *data, size_t data_len)
 {
+    CSPhaseTimer timer(CS_PHASE_TRAILER);
     int i;
-    char line[1024] = {0};
+    std::string_view line;
     pos_t pos = {0};
 
     pos.data = data;
@@ -384,54 +1868,238 @@ void CS::initTrailer(const uint8_t *data, size_t data_len)
       return;
 
     // Viewpaths
-    getLine(&pos, line, sizeof(line));
-    this->_trailer.n_viewpaths = atoi(line);
+    this->_trailer.n_viewpaths = toLong(getLine(&pos));
     for (i=0; i<this->_trailer.n_viewpaths; ++i) {
-        getLine(&pos, line, sizeof(line));
-        DBG("[%d of %d] Viewpath: %s", i+1, this->_trailer.n_viewpaths, line);
+        line = getLine(&pos);
+        DBG("[%d of %d] Viewpath: %.*s", i+1, this->_trailer.n_viewpaths,
+            (int)line.size(), line.data());
     }
 
     // Sources
-    getLine(&pos, line, sizeof(line));
-    this->_trailer.n_srcs = atoi(line);
+    this->_trailer.n_srcs = toLong(getLine(&pos));
     for (i=0; i<this->_trailer.n_srcs; ++i) {
-        getLine(&pos, line, sizeof(line));
-        DBG("[%d of %d] Sources: %s", i+1, this->_trailer.n_srcs, line);
+        line = getLine(&pos);
+        DBG("[%d of %d] Sources: %.*s", i+1, this->_trailer.n_srcs,
+            (int)line.size(), line.data());
     }
 
     // Includes
-    getLine(&pos, line, sizeof(line));
-    this->_trailer.n_incs = atoi(line);
-    getLine(&pos, line, sizeof(line));
+    this->_trailer.n_incs = toLong(getLine(&pos));
+    getLine(&pos);
     for (i=0; i<this->_trailer.n_incs; ++i) {
-        getLine(&pos, line, sizeof(line));
-        DBG("[%d of %d] Includes: %s", i+1, this->_trailer.n_incs, line);
+        line = getLine(&pos);
+        DBG("[%d of %d] Includes: %.*s", i+1, this->_trailer.n_incs,
+            (int)line.size(), line.data());
     }
+
+    cs_stats.bytes_scanned += std::min(pos.off, data_len) - this->_hdr.trailer;
 }
 
-void CS::initSymbols(const uint8_t *data, size_t data_len)
+// Parse the file section [start, end), unless the previous graph has an
+// identical section for the same file.
+CSFile *CS::loadSection(const uint8_t *data, size_t start, size_t end)
 {
-    pos_t pos = {0};
-    char line[1024];
     CSFile *file;
+    uint64_t hash = csHash(data + start, end - start);
+    auto prevs = this->_prev_files.equal_range(hash);
+
+    if (prevs.first != prevs.second) {
+        pos_t pos = {start, end, data};
+
+        file = newFile(getLine(&pos));
+        for (auto prev = prevs.first; prev != prevs.second; ++prev) {
+            if (file->getName() == this->_prev->getFileName(prev->second)) {
+                file->setHash(hash);
+                file->setPrevious(prev->second);
+                return file;
+            }
+        }
+        delete file;
+    }
 
-    pos.off = this->_hdr.syms_start;
-    pos.data = data;
-    pos.data_len = data_len;
+    file = loadFileSection(data, start, end, this->_hdr.compression);
+    file->setHash(hash);
+    return file;
+}
 
-    while (VALID(&pos) && pos.off <= this->_hdr.trailer) {
-        // Get file info
-        getLine(&pos, line, sizeof(line));
-        file = newFile(line);
-        fileLoadSymbols(file, &pos);
+// Parse the complete file sections in data[start, end) straight into the
+// streamed graph, then free them.  At 'eof' the last section is complete;
+// otherwise it may carry on past 'end' and is left for the next window.
+// Returns the offset of the first byte not consumed, and sets 'done' once
+// the end of the symbol data (an empty file mark) has been reached.
+size_t CS::streamWindow(
+    const uint8_t *data,
+    size_t         start,
+    size_t         end,
+    bool           eof,
+    bool          *done)
+{
+    auto sections = scanFileSections(data, start, end);
+    size_t n_complete = sections.size(), last = end;
+    std::vector<std::string_view> callees;
+    std::vector<uint32_t> lines;
+
+    for (size_t i=0; i<sections.size(); ++i) {
+        size_t nl = sections[i] + 2;
+        if (nl < end && data[nl] == '\n') {
+            n_complete = i;
+            last = sections[i];
+            *done = true;
+            break;
+        }
+    }
 
+    if (!*done && !eof) {
+        if (n_complete == 0)
+          return start;
+        last = sections[--n_complete];
+    }
+    else if (eof)
+      *done = true;
+
+    sections.resize(n_complete);
+    for (auto file: loadSections(data, sections, last)) {
+        this->_n_functions += addToBuilder(*this->_builder, file, callees,
+                                           lines);
+        delete file;
+    }
+
+    return last;
+}
+
+// Read the database on 'fd' (a regular file of 'size' bytes, or a pipe if
+// 'size' is 0) a window of about 'budget' bytes at a time, adding each
+// window's file sections to the graph as it goes.  Files are mapped for
+// sequential access and their pages dropped once parsed; pipes are read
+// into a buffer.  A window grows when a single section does not fit.
+void CS::streamSymbols(int fd, size_t size, size_t budget)
+{
+    CSPhaseTimer timer(CS_PHASE_PARSE);
+    bool done = false;
+    size_t off, next;
+
+    this->_builder = new CSDBBuilder(this->_prev);
+
+    if (size) {
+        const size_t page = sysconf(_SC_PAGESIZE);
+        size_t span = budget, dropped = 0;
+        uint8_t *data = (uint8_t *)mmap(NULL, size, PROT_READ, MAP_PRIVATE,
+                                        fd, 0);
+
+        if (data == MAP_FAILED)
+          throw("Error memory maping cscope database");
+        madvise(data, size, MADV_SEQUENTIAL);
+        cs_stats.database_bytes += size;
+
+        initHeader(data, size);
+        off = this->_hdr.syms_start;
+        while (!done) {
+            size_t end = std::min(off + span, size);
+            next = streamWindow(data, off, end, end == size, &done);
+            if (next == off) {
+                span *= 2;
+                continue;
+            }
+
+            // Done with these pages
+            if ((next & ~(page - 1)) > dropped) {
+                madvise(data + dropped, (next & ~(page - 1)) - dropped,
+                        MADV_DONTNEED);
+                dropped = next & ~(page - 1);
+            }
+            off = next;
+            span = budget;
+        }
+
+        munmap(data, size);
+        return;
+    }
+
+    std::vector<uint8_t> buf;
+    size_t len = 0;
+    bool eof = false;
+
+    // Read until there are 'want' bytes in the buffer, or the input ends
+    auto fill = [&](size_t want) {
+        if (buf.size() < want)
+          buf.resize(want);
+        while (len < want && !eof) {
+            ssize_t n = read(fd, buf.data() + len, want - len);
+            if (n < 0 && errno == EINTR)
+              continue;
+            if (n < 0)
+              throw("Error reading cscope database");
+            eof = (n == 0);
+            len += n;
+            cs_stats.database_bytes += n;
+        }
+    };
+
+    fill(budget);
+    initHeader(buf.data(), len);
+    off = this->_hdr.syms_start;
+    while (!done) {
+        next = streamWindow(buf.data(), off, len, eof, &done);
+
+        // Keep the unparsed tail and read more after it, growing the
+        // buffer if not even one section fit
+        memmove(buf.data(), buf.data() + next, len - next);
+        len -= next;
+        fill(next > off ? budget : std::max(budget, 2 * buf.size()));
+        off = 0;
+    }
+}
+
+// Parse the file sections starting at 'sections', the last ending at 'end',
+// on the parser threads.  Returns the files in database order, regardless
+// of which thread parsed what.
+std::vector<CSFile *> CS::loadSections(
+    const uint8_t             *data,
+    const std::vector<size_t> &sections,
+    size_t                     end)
+{
+    std::vector<CSFile *> files(sections.size());
+    std::vector<std::thread> pool;
+    std::atomic<size_t> next(0);
+
+    // Each worker claims the next unparsed section until none are left
+    auto worker = [&]() {
+        size_t i;
+        while ((i = next++) < sections.size()) {
+            size_t sec_end = (i + 1 < sections.size()) ? sections[i+1] : end;
+            files[i] = loadSection(data, sections[i], sec_end);
+        }
+    };
+
+    for (int i=1; i<this->_n_threads && (size_t)i<sections.size(); ++i)
+      pool.push_back(std::thread(worker));
+    worker();
+    for (auto &t: pool)
+      t.join();
+
+    return files;
+}
+
+void CS::initSymbols(const uint8_t *data, size_t data_len)
+{
+    CSPhaseTimer timer(CS_PHASE_PARSE);
+    size_t end = std::min(this->_hdr.trailer, data_len);
+    auto sections = scanFileSections(data, this->_hdr.syms_start, end);
+    auto files = loadSections(data, sections, end);
+
+    // Merge in database order
+    DBG("Reusing %zu of %zu file sections",
+        (size_t)std::count_if(files.begin(), files.end(),
+                              [](CSFile *f) { return f->getPrevious() >= 0; }),
+        files.size());
+    for (auto file: files) {
         // No-name file
         if (file->getName().size() == 0) {
             delete file;
             continue;
         }
 
-        // Add the file to the list of files 
+        // Add the file to the list of files
         this->addFile(file);
         this->_n_functions += file->getFunctionCount();
     }
@@ -20,100 +20,169 @@
 #ifndef _CS_HH
 #define _CS_HH
 #include <string>
-#include <vector>
+#include <map>
+#include <string_view>
 #include <unordered_map>
+#include <vector>
+#include "arena.hh"
+#include "db.hh"
+#include "emit.hh"
+#include "fnplot.hh"
+#include "inv.hh"
 
 using std::string;
 
+#define CS_FN_DEF  '$'
+#define CS_FN_CALL '`'
+
+// Graph snapshots are cached next to the cscope database
+#define CS_SNAPSHOT_EXT ".fnplot"
+
+// Default window size (bytes) for streamed loading
+#define CS_STREAM_BUDGET (64UL << 20)
+
+// Most paths a text path query lists
+#define CS_MAX_PATHS 100
+
+// Steps (edges) a query takes between looking at the clock and its cancel
+// flag
+#define CS_LIMIT_CHECK_STEPS 1024
+
 // Forwards
 struct CSSym;
 struct CSFile;
 struct CSFuncCall;
+struct CSFuncDef;
 
-// Hash of symbols
-typedef std::unordered_map<string, const CSSym *> CSSymHash;
-typedef std::unordered_map<string, std::vector<const CSFuncCall *>> CSDB;
-
-// Symbol: could be a function definition or function call
+// Symbol: could be a function definition or function call.
+// Symbols live in their file's arena and their names are interned in the
+// file's string table, so same-named symbols of a file share a name pointer.
 class CSSym
 {
 public:
-    CSSym(const char *name, char mark, size_t line, const CSFile *file) :
+    CSSym(std::string_view name, char mark, uint32_t line, const CSFile *file):
         _name(name), _mark(mark), _line(line), _file(file) {}
 
     char getMark() const { return _mark; }
-    virtual string getName() const { return _name; }
+    std::string_view getName() const { return _name; }
+    uint32_t getLine() const { return _line; }
 
 private:
-    string        _name;
-    char          _mark;
-    size_t        _line;
-    const CSFile *_file;
-    CSSymHash     _fn_defs; // Function definitions
+    std::string_view _name;
+    char             _mark;
+    uint32_t         _line;
+    const CSFile    *_file;
 };
 
 // Symbol: could be a function definition or function call
 class CSFuncCall : public CSSym
 {
 public:
-    CSFuncCall(const char *name, char mark, size_t line, const CSFile *file) :
-        CSSym(name, mark, line, file) {}
+    CSFuncCall(std::string_view name, char mark, uint32_t line,
+               const CSFile *file):
+        CSSym(name, mark, line, file), _next(nullptr) {}
+
+    const CSFuncCall *getNext() const { return _next; }
+
+private:
+    friend class CSFuncDef;
+    CSFuncCall *_next; // Next call made by the same function definition
 };
 
 // Symbol: could be a function definition or function call
 class CSFuncDef : public CSSym
 {
 public:
-    CSFuncDef(const char *name, char mark, size_t line, const CSFile *file) :
-        CSSym(name, mark, line, file) {}
+    CSFuncDef(std::string_view name, char mark, uint32_t line,
+              const CSFile *file, bool is_static):
+        CSSym(name, mark, line, file), _static(is_static),
+        _callees(nullptr), _last_callee(nullptr), _next(nullptr) {}
 
-    void getCallees(std::vector<const CSFuncCall *> &addem) const {
-        for (auto callee: _callees)
-          addem.push_back(static_cast<const CSFuncCall *>(callee.second));
-    }
+    const CSFuncCall *getCallees() const { return _callees; }
+    const CSFuncDef *getNext() const { return _next; }
+    bool isStatic() const { return _static; }
 
-    // Unique add
-    void addCallee(const CSFuncCall *fncall) {
-        auto pr = std::make_pair<string, const CSSym *>(fncall->getName(), fncall);
-        _callees.insert(pr);
+    void addCallee(CSFuncCall *fncall) {
+        if (_last_callee)
+          _last_callee->_next = fncall;
+        else
+          _callees = fncall;
+        _last_callee = fncall;
     }
 
 private:
-        CSSymHash _callees; // Function calls
+    friend class CSFile;
+    bool        _static;
+    CSFuncCall *_callees;     // Function calls, in call order
+    CSFuncCall *_last_callee;
+    CSFuncDef  *_next;        // Next definition in the same file
 };
 
 // A file entry contains a list of symbols, we only collect function calls here.
 class CSFile
 {
 public:
-    CSFile(const char *name, char mark):
-        _name(name), _mark(mark), _current_fndef(nullptr) {}
+    CSFile(std::string_view name, char mark):
+        _name(name), _mark(mark), _n_functions(0), _hash(0), _prev(-1),
+        _functions(nullptr), _current_fndef(nullptr) {}
+
+    // Fingerprint of the file's section of the database
+    uint64_t getHash() const { return _hash; }
+    void setHash(uint64_t hash) { _hash = hash; }
+
+    // Index of this (unchanged, so unparsed) file in the previous graph,
+    // or -1 if the file was parsed.
+    long getPrevious() const { return _prev; }
+    void setPrevious(long idx) { _prev = idx; }
 
     CSFuncDef *getCurrentFunction() const { return _current_fndef; }
-    string getName() const { return _name; }
-    const CSSymHash *getFunctions() { return &_functions; }
-    size_t getFunctionCount() const { return _functions.size(); }
+    const string &getName() const { return _name; }
+    const CSFuncDef *getFunctions() const { return _functions; }
+    size_t getFunctionCount() const { return _n_functions; }
 
-    void addFunctionDef(CSFuncDef *fndef) {
-        auto pr = std::make_pair<string, const CSSym *>(fndef->getName(), fndef);
-        _functions.insert(pr);
+    void addFunctionDef(std::string_view name, uint32_t line, bool is_static) {
+        auto fndef = _arena.make<CSFuncDef>(intern(name), CS_FN_DEF, line,
+                                            this, is_static);
+        if (_current_fndef)
+          _current_fndef->_next = fndef;
+        else
+          _functions = fndef;
         _current_fndef = fndef;
+        ++_n_functions;
+    }
+
+    // Every call site is kept, the graph counts repeated calls
+    void addFunctionCall(std::string_view name, uint32_t line) {
+        if (!_current_fndef)
+          return;
+        auto fncall = _arena.make<CSFuncCall>(intern(name), CS_FN_CALL, line,
+                                              this);
+        _current_fndef->addCallee(fncall);
     }
 
 private:
-    string    _name;
-    char      _mark;
-    CSSymHash _functions;
+    string     _name;
+    char       _mark;
+    size_t     _n_functions;
+    uint64_t   _hash;
+    long       _prev;
+    CSArena    _arena;   // Holds the symbols
+    CSStrTab   _strs;    // Holds the symbol names
+    CSFuncDef *_functions; // In definition order
 
     // The current function being added to (callees being added).
     CSFuncDef *_current_fndef;
+
+    std::string_view intern(std::string_view name) {
+        return _strs.get(_strs.intern(name));
+    }
 };
 
 // cscope database (cscope.out) header
 struct CSHeader
 {
     int         version;
-    bool        compression;    /* -c */
+    bool        compression;    /* Not -c */
     bool        inverted_index; /* -q */
     bool        prefix_match;   /* -T */
     size_t      syms_start;
@@ -136,27 +205,63 @@ struct CSTrailer
 struct CS
 {
 public:
-    CS(const char *fname);
+    // With 'load_symbols' false, no file sections are parsed up front; see
+    // loadNeighbourhood.  With 'stream_budget', or for input that is not a
+    // regular file (such as "-" for stdin), the database is read that many
+    // bytes at a time and each file section goes straight into the graph;
+    // see streamSymbols.
+    CS(const char *fname, int n_threads=1, const CSDB *prev=NULL,
+       bool load_symbols=true, size_t stream_budget=0);
+    ~CS();
     void addFile(CSFile *f) { _files.push_back(f); }
     CSDB *buildDatabase();
+    bool hasInvertedIndex() const { return _hdr.inverted_index; }
+
+    // Parse only the file sections that a 'depth' deep callers and/or
+    // callees query of 'fn_name' can reach, found through 'inv'.  Returns
+    // false if the index does not agree with the database.
+    bool loadNeighbourhood(const CSInvIndex *inv, const char *fn_name,
+                           int depth, bool callers, bool callees);
 
 private:
     CSHeader               _hdr;
     CSTrailer              _trailer;
+    CSDBSource             _src;
     const char            *_name;
     int                    _n_functions;
+    int                    _n_threads; // Parser threads
     std::vector<CSFile *>  _files;
+    const uint8_t         *_data;      // The mapped database
+    size_t                 _data_len;
+    CSDBBuilder           *_builder;   // The graph so far, when streaming
+
+    // Lazily parsed file sections, by offset
+    std::map<size_t, CSFile *> _sections;
+
+    // Graph to carry unchanged file sections over from, by fingerprint
+    const CSDB                                *_prev;
+    std::unordered_multimap<uint64_t, size_t>  _prev_files;
 
     void initHeader(const uint8_t *data, size_t data_size);
     void initTrailer(const uint8_t *data, size_t data_size);
     void initSymbols(const uint8_t *data, size_t data_size);
+    void streamSymbols(int fd, size_t size, size_t budget);
+    size_t streamWindow(const uint8_t *data, size_t start, size_t end,
+                        bool eof, bool *done);
+    std::vector<CSFile *> loadSections(const uint8_t *data,
+                                       const std::vector<size_t> &sections,
+                                       size_t end);
+    int addToBuilder(CSDBBuilder &builder, const CSFile *f,
+                     std::vector<std::string_view> &callees,
+                     std::vector<uint32_t> &lines);
+    CSFile *loadSection(const uint8_t *data, size_t start, size_t end);
+    CSFile *loadSectionAt(size_t off);
+    bool loadPostings(const CSInvIndex *inv, const string &term, char mark,
+                      std::vector<CSFile *> &files);
     void loadCScope();
 };
 
-
-#define CS_FN_DEF  '$'
-#define CS_FN_CALL '`'
-static const char cs_marks[] =
+static constexpr char cs_marks[] =
 {
     '@', CS_FN_DEF, CS_FN_CALL,
     '}', '#', ')',
@@ -166,10 +271,4 @@ static const char cs_marks[] =
     's', 't', 'u'
 };
 
-
-// Public routines
-extern void csPrintCallers(FILE *out, CSDB *db, const char *fn_name, int depth);
-extern void csPrintCallees(FILE *out, CSDB *db, const char *fn_name, int depth);
-
-
 #endif // _CS_HH
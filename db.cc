@@ -0,0 +1,1369 @@
+//******************************************************************************
+// Copyright (c) 2016, enferex <mattdavis9@gmail.com>
+//
+// ISC License:
+// https://www.isc.org/downloads/software-support-policy/isc-license/
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+// REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+// AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+// OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+//******************************************************************************
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <unordered_map>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "db.hh"
+#include "stats.hh"
+
+static_assert(sizeof(CSDBHeader) % 8 == 0, "CSDB sections must stay aligned");
+
+CSDB::~CSDB()
+{
+    if (_map)
+      munmap(_map, _map_size);
+}
+
+// Point the accessors at 'image', after checking that it is a complete image
+// of this version.  Nothing in the image needs fixing up.
+bool CSDB::setImage(const void *image, size_t size)
+{
+    auto hdr = (const CSDBHeader *)image;
+    auto base = (const char *)image;
+    uint64_t n_fns, n_edges, n_files, n_defs, n_sccs;
+
+    if (size < sizeof(CSDBHeader) ||
+        memcmp(hdr->magic, CSDB_MAGIC, sizeof(hdr->magic)) ||
+        hdr->version != CSDB_VERSION ||
+        hdr->size != size)
+      return false;
+
+    for (auto &sec: hdr->sections)
+      if (sec.off % 8 || sec.off > size || sec.size > size - sec.off)
+        return false;
+
+    // Sections must agree with the counts
+    n_fns = hdr->n_functions;
+    n_edges = hdr->n_edges;
+    n_files = hdr->n_files;
+    n_defs = hdr->n_defs;
+    n_sccs = hdr->n_sccs;
+    auto &secs = hdr->sections;
+    if (secs[CSDB_STRTAB].size == 0 ||
+        base[secs[CSDB_STRTAB].off + secs[CSDB_STRTAB].size - 1] != '\0' ||
+        secs[CSDB_NAME_OFF].size != n_fns * sizeof(uint32_t) ||
+        secs[CSDB_SORTED].size != n_fns * sizeof(CSFnId) ||
+        secs[CSDB_CALLEE_OFF].size != (n_fns + 1) * sizeof(uint64_t) ||
+        secs[CSDB_CALLEE_EDGES].size != n_edges * sizeof(CSFnId) ||
+        secs[CSDB_CALLER_OFF].size != (n_fns + 1) * sizeof(uint64_t) ||
+        secs[CSDB_CALLER_EDGES].size != n_edges * sizeof(CSFnId) ||
+        secs[CSDB_FILES].size != n_files * sizeof(CSDBFile) ||
+        secs[CSDB_FILE_DEF_OFF].size != (n_files + 1) * sizeof(uint64_t) ||
+        secs[CSDB_DEFS].size != n_defs * sizeof(CSFnId) ||
+        secs[CSDB_DEF_CALL_OFF].size != (n_defs + 1) * sizeof(uint64_t) ||
+        secs[CSDB_DEF_CALLS].size != hdr->n_calls * sizeof(CSFnId) ||
+        secs[CSDB_SCC].size != n_fns * sizeof(CSSccId) ||
+        secs[CSDB_SCC_FN_OFF].size != (n_sccs + 1) * sizeof(uint64_t) ||
+        secs[CSDB_SCC_FNS].size != n_fns * sizeof(CSFnId) ||
+        secs[CSDB_SCC_SUCC_OFF].size != (n_sccs + 1) * sizeof(uint64_t) ||
+        secs[CSDB_SCC_SUCCS].size != hdr->n_scc_edges * sizeof(CSSccId) ||
+        secs[CSDB_SCC_PRED_OFF].size != (n_sccs + 1) * sizeof(uint64_t) ||
+        secs[CSDB_SCC_PREDS].size != hdr->n_scc_edges * sizeof(CSSccId) ||
+        secs[CSDB_CALLEE_RANK].size != n_edges * sizeof(CSFnId) ||
+        secs[CSDB_CALLER_RANK].size != n_edges * sizeof(CSFnId) ||
+        secs[CSDB_FN_FILE].size != n_fns * sizeof(uint32_t) ||
+        secs[CSDB_DEF_FILE].size != n_defs * sizeof(uint32_t) ||
+        secs[CSDB_DEF_LINE].size != n_defs * sizeof(uint32_t) ||
+        secs[CSDB_DEF_FLAGS].size != n_defs * sizeof(uint8_t) ||
+        secs[CSDB_CALL_LINE].size != hdr->n_calls * sizeof(uint32_t) ||
+        secs[CSDB_CALLEE_COUNT].size != n_edges * sizeof(uint32_t) ||
+        secs[CSDB_FN_BASE].size != n_fns * sizeof(CSFnId) ||
+        secs[CSDB_CALLEE_ORDER].size != n_edges * sizeof(uint32_t))
+      return false;
+
+    _hdr = hdr;
+    _strtab = base + secs[CSDB_STRTAB].off;
+    _name_off = (const uint32_t *)(base + secs[CSDB_NAME_OFF].off);
+    _sorted = (const CSFnId *)(base + secs[CSDB_SORTED].off);
+    _callee_off = (const uint64_t *)(base + secs[CSDB_CALLEE_OFF].off);
+    _callee_edges = (const CSFnId *)(base + secs[CSDB_CALLEE_EDGES].off);
+    _caller_off = (const uint64_t *)(base + secs[CSDB_CALLER_OFF].off);
+    _caller_edges = (const CSFnId *)(base + secs[CSDB_CALLER_EDGES].off);
+    _files = (const CSDBFile *)(base + secs[CSDB_FILES].off);
+    _file_def_off = (const uint64_t *)(base + secs[CSDB_FILE_DEF_OFF].off);
+    _defs = (const CSFnId *)(base + secs[CSDB_DEFS].off);
+    _def_call_off = (const uint64_t *)(base + secs[CSDB_DEF_CALL_OFF].off);
+    _def_calls = (const CSFnId *)(base + secs[CSDB_DEF_CALLS].off);
+    _scc = (const CSSccId *)(base + secs[CSDB_SCC].off);
+    _scc_fn_off = (const uint64_t *)(base + secs[CSDB_SCC_FN_OFF].off);
+    _scc_fns = (const CSFnId *)(base + secs[CSDB_SCC_FNS].off);
+    _scc_succ_off = (const uint64_t *)(base + secs[CSDB_SCC_SUCC_OFF].off);
+    _scc_succs = (const CSSccId *)(base + secs[CSDB_SCC_SUCCS].off);
+    _scc_pred_off = (const uint64_t *)(base + secs[CSDB_SCC_PRED_OFF].off);
+    _scc_preds = (const CSSccId *)(base + secs[CSDB_SCC_PREDS].off);
+    _callee_ranked = (const CSFnId *)(base + secs[CSDB_CALLEE_RANK].off);
+    _caller_ranked = (const CSFnId *)(base + secs[CSDB_CALLER_RANK].off);
+    _fn_file = (const uint32_t *)(base + secs[CSDB_FN_FILE].off);
+    _def_file = (const uint32_t *)(base + secs[CSDB_DEF_FILE].off);
+    _def_line = (const uint32_t *)(base + secs[CSDB_DEF_LINE].off);
+    _def_flags = (const uint8_t *)(base + secs[CSDB_DEF_FLAGS].off);
+    _call_line = (const uint32_t *)(base + secs[CSDB_CALL_LINE].off);
+    _callee_count = (const uint32_t *)(base + secs[CSDB_CALLEE_COUNT].off);
+    _fn_base = (const CSFnId *)(base + secs[CSDB_FN_BASE].off);
+    _callee_order = (const uint32_t *)(base + secs[CSDB_CALLEE_ORDER].off);
+    return true;
+}
+
+// Whether the 'n' + 1 offsets 'off' run from 0 up to 'last' in order
+static bool validOffsets(const uint64_t *off, size_t n, uint64_t last)
+{
+    if (off[0] != 0 || off[n] != last)
+      return false;
+    for (size_t i=0; i<n; ++i)
+      if (off[i] > off[i+1])
+        return false;
+    return true;
+}
+
+// Whether each of the 'n' 'ids' is below 'limit' (or is 'none')
+template <typename T>
+static bool validIds(const T *ids, size_t n, uint64_t limit,
+                     uint64_t none=UINT64_MAX)
+{
+    for (size_t i=0; i<n; ++i)
+      if (ids[i] >= limit && ids[i] != none)
+        return false;
+    return true;
+}
+
+// Check that everything in the image that indexes something else is in
+// bounds, so a damaged snapshot is rejected rather than read out of bounds.
+// setImage() has only checked the section sizes.
+bool CSDB::validate() const
+{
+    const size_t n_fns = getFunctionCount(), n_edges = getEdgeCount();
+    const size_t n_files = getFileCount(), n_defs = getDefCount();
+    const size_t n_calls = getCallCount(), n_sccs = getSccCount();
+    const size_t n_scc_edges = _hdr->n_scc_edges;
+    const size_t strtab_size = _hdr->sections[CSDB_STRTAB].size;
+
+    if (!validOffsets(_callee_off, n_fns, n_edges) ||
+        !validOffsets(_caller_off, n_fns, n_edges) ||
+        !validOffsets(_file_def_off, n_files, n_defs) ||
+        !validOffsets(_def_call_off, n_defs, n_calls) ||
+        !validOffsets(_scc_fn_off, n_sccs, n_fns) ||
+        !validOffsets(_scc_succ_off, n_sccs, n_scc_edges) ||
+        !validOffsets(_scc_pred_off, n_sccs, n_scc_edges))
+      return false;
+
+    if (!validIds(_name_off, n_fns, strtab_size))
+      return false;
+    for (size_t fn=0; fn<n_fns; ++fn) {
+        size_t len = _callee_off[fn+1] - _callee_off[fn];
+        if (!validIds(_callee_order + _callee_off[fn], len, len))
+          return false;
+    }
+    for (size_t f=0; f<n_files; ++f)
+      if (_files[f].name >= strtab_size)
+        return false;
+
+    return validIds(_sorted, n_fns, n_fns) &&
+           validIds(_callee_edges, n_edges, n_fns) &&
+           validIds(_caller_edges, n_edges, n_fns) &&
+           validIds(_callee_ranked, n_edges, n_fns) &&
+           validIds(_caller_ranked, n_edges, n_fns) &&
+           validIds(_defs, n_defs, n_fns) &&
+           validIds(_def_calls, n_calls, n_fns) &&
+           validIds(_scc, n_fns, n_sccs) &&
+           validIds(_scc_fns, n_fns, n_fns) &&
+           validIds(_scc_succs, n_scc_edges, n_sccs) &&
+           validIds(_scc_preds, n_scc_edges, n_sccs) &&
+           validIds(_fn_file, n_fns, n_files, CSDB_NO_FILE) &&
+           validIds(_def_file, n_defs, n_files) &&
+           validIds(_fn_base, n_fns, n_fns);
+}
+
+CSDB *CSDB::load(const char *fname)
+{
+    int fd;
+    void *map;
+    struct stat st;
+
+    if ((fd = open(fname, O_RDONLY)) == -1)
+      return NULL;
+    if (fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(CSDBHeader)) {
+        close(fd);
+        return NULL;
+    }
+
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+      return NULL;
+
+    auto db = new CSDB;
+    db->_map = map;
+    db->_map_size = st.st_size;
+    if (!db->setImage(map, st.st_size) || !db->validate()) {
+        delete db;
+        return NULL;
+    }
+
+    return db;
+}
+
+// Write the image to a temporary file and rename it into place, so readers
+// never see a partial snapshot.
+bool CSDB::save(const char *fname) const
+{
+    FILE *fp;
+    bool ok;
+    string tmp = string(fname) + ".tmp." + std::to_string(getpid());
+
+    if (!(fp = fopen(tmp.c_str(), "w")))
+      return false;
+
+    ok = fwrite(_hdr, 1, _hdr->size, fp) == _hdr->size;
+    ok = (fclose(fp) == 0) && ok;
+    if (ok)
+      ok = rename(tmp.c_str(), fname) == 0;
+    if (!ok)
+      unlink(tmp.c_str());
+
+    return ok;
+}
+
+// Binary search the name-sorted ids
+bool CSDB::getId(const char *name, CSFnId *id) const
+{
+    auto last = _sorted + getFunctionCount();
+    auto it = std::lower_bound(_sorted, last, name,
+        [this](CSFnId a, const char *b) { return strcmp(getName(a), b) < 0; });
+
+    if (it == last || strcmp(getName(*it), name) != 0)
+      return false;
+
+    *id = *it;
+    return true;
+}
+
+// The names starting with 'prefix' are a run of the name-sorted ids
+CSRange CSDB::getPrefix(const char *prefix) const
+{
+    size_t len = strlen(prefix);
+    auto last = _sorted + getFunctionCount();
+    auto first = std::lower_bound(_sorted, last, prefix,
+        [this, len](CSFnId a, const char *b) {
+            return strncmp(getName(a), b, len) < 0;
+        });
+    auto end = std::upper_bound(first, last, prefix,
+        [this, len](const char *a, CSFnId b) {
+            return strncmp(a, getName(b), len) < 0;
+        });
+
+    CSRange r = {first, end};
+    return r;
+}
+
+uint32_t CSDB::countCalls(CSFnId caller, CSFnId callee) const
+{
+    const CSFnId *row = getCallees(caller).first;
+    const uint32_t *first = getCalleeOrder(caller);
+    const uint32_t *last = getCalleeOrder(caller + 1);
+    auto it = std::lower_bound(first, last, callee,
+        [row](uint32_t pos, CSFnId id) { return row[pos] < id; });
+    return (it != last && row[*it] == callee) ?
+           getCalleeCounts(caller)[*it] : 0;
+}
+
+void CSDBBuilder::addFile(std::string_view name, uint64_t hash)
+{
+    _file_hash.push_back(hash);
+    _file_name.push_back(_file_names.intern(name));
+    _file_def_off.push_back(_defs.size());
+    _file_prev.push_back(CSDB_NO_FILE);
+}
+
+// Add file 'f' of 'db' along with its definitions, as 'name' if given.
+// Per-file copies go back to the names they were made from, as the copies
+// 'db' needed need not be the ones this graph does.
+void CSDBBuilder::addFileFrom(const CSDB *db, size_t f, std::string_view name)
+{
+    std::vector<std::string_view> callees;
+    std::vector<uint32_t> lines;
+    uint64_t d, last = db->getFileDefs(f + 1);
+
+    if (name.empty())
+      name = db->getFileName(f);
+
+    // The unchanged files of a reload look each name up once, and add the
+    // definitions in the order addFunction() would
+    if (db == _prev) {
+        auto fnName = [&](CSFnId fn) {
+            uint32_t &id = _prev_name[fn];
+            if (!id)
+              id = _names.intern(db->getName(db->getBaseFunction(fn))) + 1;
+            return id - 1;
+        };
+
+        // Most of a reload is usually from 'db', so size for all of it
+        if (_prev_name.empty()) {
+            _prev_name.resize(db->getFunctionCount());
+            _names.reserve(db->getFunctionCount());
+            _defs.reserve(db->getDefCount());
+            _def_line.reserve(db->getDefCount());
+            _def_flags.reserve(db->getDefCount());
+            _def_call_off.reserve(db->getDefCount() + 1);
+            _def_calls.reserve(db->getCallCount());
+            _call_line.reserve(db->getCallCount());
+        }
+        addFile(name, db->getFileHash(f));
+        _file_prev.back() = f;
+        for (d = db->getFileDefs(f); d < last; ++d) {
+            CSRange calls = db->getDefCalls(d);
+            const uint32_t *line = db->getDefCallLines(d);
+            _defs.push_back(fnName(db->getDefFunction(d)));
+            _def_line.push_back(db->getDefLine(d));
+            _def_flags.push_back(db->isDefStatic(d) ? CSDB_DEF_STATIC : 0);
+            for (auto callee: calls)
+              _def_calls.push_back(fnName(callee));
+            _call_line.insert(_call_line.end(), line, line + calls.size());
+            _def_call_off.push_back(_def_calls.size());
+        }
+        _file_def_off.back() = _defs.size();
+        return;
+    }
+
+    addFile(name, db->getFileHash(f));
+    for (d = db->getFileDefs(f); d < last; ++d) {
+        const uint32_t *line = db->getDefCallLines(d);
+        callees.clear();
+        lines.clear();
+        for (auto callee: db->getDefCalls(d)) {
+            callees.push_back(db->getName(db->getBaseFunction(callee)));
+            lines.push_back(*line++);
+        }
+        addFunction(db->getName(db->getBaseFunction(db->getDefFunction(d))),
+                    db->getDefLine(d), db->isDefStatic(d), callees, lines);
+    }
+}
+
+// Add a definition of 'name' at 'line' of the current file, making the
+// calls 'callees' at 'lines'
+void CSDBBuilder::addFunction(
+    std::string_view                     name,
+    uint32_t                             line,
+    bool                                 is_static,
+    const std::vector<std::string_view> &callees,
+    const std::vector<uint32_t>         &lines)
+{
+    _defs.push_back(_names.intern(name));
+    _def_line.push_back(line);
+    _def_flags.push_back(is_static ? CSDB_DEF_STATIC : 0);
+    _file_def_off.back() = _defs.size();
+
+    for (auto &callee: callees)
+      _def_calls.push_back(_names.intern(callee));
+    _call_line.insert(_call_line.end(), lines.begin(), lines.end());
+    _def_call_off.push_back(_def_calls.size());
+}
+
+// Work out the function of each definition ('defs') and call ('calls').  A
+// name defined in one file is one function.  A name defined in several is a
+// function per file: the file that other files' calls go to keeps the name,
+// that being the first to define it without 'static' (or failing that the
+// first to define it), and the others each get a copy, 'base' saying which
+// name it is a copy of.  Calls go to their own file's function if it has
+// one.  Files are told apart by name (see csLoadDatabases).
+void CSDBBuilder::resolve(
+    std::vector<CSFnId> &defs,
+    std::vector<CSFnId> &calls,
+    std::vector<CSFnId> &base)
+{
+    const size_t n_names = _names.size(), n_files = _file_name.size();
+    const uint32_t none = UINT32_MAX;
+    std::vector<uint32_t> first(n_names, none), owner(n_names, none);
+    std::vector<bool> several(n_names);
+    std::unordered_map<uint64_t, CSFnId> copies; // (name, file) -> copy
+
+    for (size_t f=0; f<n_files; ++f) {
+        uint32_t file = _file_name[f];
+        for (auto d=_file_def_off[f]; d<_file_def_off[f+1]; ++d) {
+            CSFnId name = _defs[d];
+            if (first[name] == none)
+              first[name] = file;
+            else if (first[name] != file)
+              several[name] = true;
+            if (owner[name] == none && !(_def_flags[d] & CSDB_DEF_STATIC))
+              owner[name] = file;
+        }
+    }
+
+    for (size_t f=0; f<n_files; ++f) {
+        uint32_t file = _file_name[f];
+        for (auto d=_file_def_off[f]; d<_file_def_off[f+1]; ++d) {
+            CSFnId name = _defs[d];
+            uint64_t key = (uint64_t)name << 32 | file;
+            if (!several[name] || copies.count(key) ||
+                file == (owner[name] != none ? owner[name] : first[name]))
+              continue;
+
+            string copy(_names.get(name));
+            copy += CSDB_COPY_SEP;
+            copy += _file_names.get(file);
+            copies[key] = _names.intern(copy);
+        }
+    }
+
+    base.resize(_names.size());
+    for (CSFnId i=0; i<base.size(); ++i)
+      base[i] = i;
+    for (const auto &c: copies)
+      base[c.second] = c.first >> 32;
+
+    defs = _defs;
+    calls = _def_calls;
+    if (copies.empty())
+      return;
+
+    auto lookup = [&](CSFnId name, uint32_t file) {
+        if (!several[name])
+          return name;
+        auto it = copies.find((uint64_t)name << 32 | file);
+        return it == copies.end() ? name : it->second;
+    };
+    for (size_t f=0; f<n_files; ++f) {
+        uint32_t file = _file_name[f];
+        for (auto d=_file_def_off[f]; d<_file_def_off[f+1]; ++d) {
+            defs[d] = lookup(defs[d], file);
+            for (auto c=_def_call_off[d]; c<_def_call_off[d+1]; ++c)
+              calls[c] = lookup(calls[c], file);
+        }
+    }
+}
+
+// Counting sort the (src, dst) edges into offset/edge arrays keyed by src.
+// Edges keep their insertion order within each src.
+static void buildCSR(
+    const std::vector<std::pair<CSFnId, CSFnId>> &edges,
+    size_t                                        n_fns,
+    bool                                          by_callee,
+    std::vector<uint64_t>                        &off,
+    std::vector<CSFnId>                          &out)
+{
+    off.assign(n_fns + 1, 0);
+    for (auto &e: edges)
+      ++off[(by_callee ? e.second : e.first) + 1];
+    for (size_t i=0; i<n_fns; ++i)
+      off[i+1] += off[i];
+
+    std::vector<uint64_t> fill(off.begin(), off.end() - 1);
+    out.resize(edges.size());
+    for (auto &e: edges) {
+        if (by_callee)
+          out[fill[e.second]++] = e.first;
+        else
+          out[fill[e.first]++] = e.second;
+    }
+}
+
+// Order the neighbours [first, last) by their own number of neighbours
+// ('off'), most first.  Ties keep their order.
+static void rankRow(
+    const std::vector<uint64_t> &off,
+    CSFnId                      *first,
+    CSFnId                      *last)
+{
+    auto degree = [&off](CSFnId fn) { return off[fn+1] - off[fn]; };
+
+    std::stable_sort(first, last, [&](CSFnId a, CSFnId b) {
+        return degree(a) > degree(b);
+    });
+}
+
+// Fill 'order' with the positions of the 'n' ids in 'row', in order of id
+static void orderRow(const CSFnId *row, uint32_t *order, size_t n)
+{
+    for (size_t i=0; i<n; ++i)
+      order[i] = i;
+    std::sort(order, order + n, [row](uint32_t a, uint32_t b) {
+        return row[a] < row[b];
+    });
+}
+
+// Copy the CSR 'edges', ranking each function's neighbours (see rankRow)
+static void rankCSR(
+    const std::vector<uint64_t> &off,
+    const std::vector<CSFnId>   &edges,
+    std::vector<CSFnId>         &ranked)
+{
+    ranked = edges;
+    for (size_t i=0; i+1<off.size(); ++i)
+      rankRow(off, ranked.data() + off[i], ranked.data() + off[i+1]);
+}
+
+// Number the strongly connected components of the callee graph in 'scc',
+// returning how many there are.  This is Tarjan's algorithm with an explicit
+// stack, so long call chains cannot overflow ours.  Components are numbered
+// as they are completed, which is after every component they call.
+static size_t findSCCs(
+    size_t                       n_fns,
+    const std::vector<uint64_t> &off,
+    const std::vector<CSFnId>   &edges,
+    std::vector<CSSccId>        &scc)
+{
+    const uint32_t unvisited = UINT32_MAX;
+    std::vector<uint32_t> index(n_fns, unvisited), low(n_fns);
+    std::vector<uint64_t> next(n_fns); // Next callee to visit of each function
+    std::vector<bool> on_stack(n_fns);
+    std::vector<CSFnId> stack, path;
+    uint32_t n_visited = 0;
+    size_t n_sccs = 0;
+
+    auto visit = [&](CSFnId fn) {
+        index[fn] = low[fn] = n_visited++;
+        next[fn] = off[fn];
+        stack.push_back(fn);
+        on_stack[fn] = true;
+        path.push_back(fn);
+    };
+
+    scc.assign(n_fns, 0);
+    for (CSFnId root=0; root<n_fns; ++root) {
+        if (index[root] != unvisited)
+          continue;
+
+        visit(root);
+        while (!path.empty()) {
+            CSFnId fn = path.back();
+            if (next[fn] < off[fn+1]) {
+                CSFnId callee = edges[next[fn]++];
+                if (index[callee] == unvisited)
+                  visit(callee);
+                else if (on_stack[callee])
+                  low[fn] = std::min(low[fn], index[callee]);
+                continue;
+            }
+
+            // All of fn's callees are done
+            path.pop_back();
+            if (!path.empty())
+              low[path.back()] = std::min(low[path.back()], low[fn]);
+            if (low[fn] == index[fn]) {
+                CSFnId member;
+                do {
+                    member = stack.back();
+                    stack.pop_back();
+                    on_stack[member] = false;
+                    scc[member] = n_sccs;
+                } while (member != fn);
+                ++n_sccs;
+            }
+        }
+    }
+
+    return n_sccs;
+}
+
+// Assembles a CSDB image: the header followed by 8-byte aligned sections.
+// The sections are only copied in by finish(), into an image allocated once,
+// so they must stay alive until then.
+class CSDBWriter
+{
+public:
+    CSDBWriter() : _size(sizeof(CSDBHeader)) {
+        memset(&this->_hdr, 0, sizeof(this->_hdr));
+    }
+
+    CSDBHeader *getHeader() { return &this->_hdr; }
+
+    void add(CSDBSection sec, const void *data, size_t size) {
+        this->_hdr.sections[sec].off = this->_size;
+        this->_hdr.sections[sec].size = size;
+        this->_data[sec] = data;
+        this->_size += (size + 7) & ~(size_t)7;
+    }
+
+    template <typename T> void add(CSDBSection sec, const std::vector<T> &v) {
+        add(sec, v.data(), v.size() * sizeof(T));
+    }
+
+    std::vector<uint64_t> finish() {
+        std::vector<uint64_t> image(this->_size / 8);
+        char *base = (char *)image.data();
+
+        this->_hdr.size = this->_size;
+        memcpy(base, &this->_hdr, sizeof(this->_hdr));
+        for (int i=0; i<CSDB_N_SECTIONS; ++i)
+          if (this->_hdr.sections[i].size)
+            memcpy(base + this->_hdr.sections[i].off, this->_data[i],
+                   this->_hdr.sections[i].size);
+        return image;
+    }
+
+private:
+    CSDBHeader _hdr;
+    const void *_data[CSDB_N_SECTIONS] = {};
+    size_t _size;
+};
+
+// The sections of a graph being laid out that follow from its definitions
+// and calls (see CSDBSection)
+struct CSDBParts
+{
+    size_t                n_fns;
+    std::vector<CSFnId>   defs;  // Function of each definition
+    std::vector<CSFnId>   calls; // And of each call
+    std::vector<CSFnId>   fn_base;
+    std::vector<CSFnId>   sorted;
+    std::vector<uint64_t> callee_off, caller_off;
+    std::vector<CSFnId>   callee_edges, caller_edges;
+    std::vector<CSFnId>   callee_ranked, caller_ranked;
+    std::vector<uint32_t> callee_count, callee_order;
+    std::vector<CSSccId>  scc;
+    size_t                n_sccs;
+    std::vector<uint64_t> scc_fn_off, scc_succ_off, scc_pred_off;
+    std::vector<CSFnId>   scc_fns;
+    std::vector<CSSccId>  scc_succs, scc_preds;
+};
+
+// Collect in 'pairs' the distinct calls between groups of nodes, given the
+// calls of each node ('off', 'edges'), its group ('group') and the nodes of
+// each group ('group_off', 'nodes')
+static void callsBetween(
+    const std::vector<uint32_t>            &group,
+    const std::vector<uint64_t>            &group_off,
+    const std::vector<CSFnId>              &nodes,
+    const std::vector<uint64_t>            &off,
+    const std::vector<CSFnId>              &edges,
+    std::vector<std::pair<CSFnId, CSFnId>> &pairs)
+{
+    const size_t n_groups = group_off.size() - 1;
+    std::vector<uint32_t> last(n_groups, UINT32_MAX); // Last caller of each
+
+    pairs.clear();
+    for (uint32_t c=0; c<n_groups; ++c) {
+        for (auto i=group_off[c]; i<group_off[c+1]; ++i) {
+            auto node = nodes[i];
+            for (auto e=off[node]; e<off[node+1]; ++e) {
+                uint32_t to = group[edges[e]];
+                if (to != c && last[to] != c) {
+                    last[to] = c;
+                    pairs.push_back(std::make_pair(c, to));
+                }
+            }
+        }
+    }
+}
+
+// Group the functions by their component (g.scc)
+static void groupSCCs(CSDBParts &g)
+{
+    std::vector<std::pair<CSFnId, CSFnId>> pairs;
+
+    pairs.reserve(g.n_fns);
+    for (CSFnId i=0; i<g.n_fns; ++i)
+      pairs.push_back(std::make_pair(g.scc[i], i));
+    buildCSR(pairs, g.n_sccs, false, g.scc_fn_off, g.scc_fns);
+}
+
+// Lay the graph out from scratch: sort the names, take each function's
+// edges from its first definition, then rank and condense them
+void CSDBBuilder::build(
+    CSDBParts                   &g,
+    const std::vector<char>     &strtab,
+    const std::vector<uint32_t> &name_off)
+{
+    const size_t n_fns = g.n_fns;
+    std::vector<std::pair<CSFnId, CSFnId>> edges; // (caller, callee)
+    std::vector<uint32_t> counts;
+
+    g.sorted.resize(n_fns);
+    for (size_t i=0; i<n_fns; ++i)
+      g.sorted[i] = i;
+    std::sort(g.sorted.begin(), g.sorted.end(), [&](CSFnId a, CSFnId b) {
+        return strcmp(&strtab[name_off[a]], &strtab[name_off[b]]) < 0;
+    });
+
+    // The first definition of a function provides its edges, one to each
+    // function it calls, counting the calls
+    std::vector<bool> provided(n_fns);
+    std::vector<uint64_t> at(n_fns, UINT64_MAX); // Edge to each callee
+    for (size_t d=0; d<g.defs.size(); ++d) {
+        CSFnId fn = g.defs[d];
+        size_t start = edges.size();
+        if (provided[fn])
+          continue;
+        provided[fn] = true;
+        for (auto c=_def_call_off[d]; c<_def_call_off[d+1]; ++c) {
+            CSFnId to = g.calls[c];
+            if (at[to] != UINT64_MAX && at[to] >= start)
+              ++counts[at[to]];
+            else {
+                at[to] = edges.size();
+                edges.push_back(std::make_pair(fn, to));
+                counts.push_back(1);
+            }
+        }
+    }
+
+    buildCSR(edges, n_fns, false, g.callee_off, g.callee_edges);
+    buildCSR(edges, n_fns, true, g.caller_off, g.caller_edges);
+    rankCSR(g.callee_off, g.callee_edges, g.callee_ranked);
+    rankCSR(g.caller_off, g.caller_edges, g.caller_ranked);
+
+    // Counts go where buildCSR put their edges
+    std::vector<uint64_t> fill(g.callee_off.begin(), g.callee_off.end() - 1);
+    g.callee_count.resize(edges.size());
+    for (size_t e=0; e<edges.size(); ++e)
+      g.callee_count[fill[edges[e].first]++] = counts[e];
+    g.callee_order.resize(edges.size());
+    for (size_t i=0; i<n_fns; ++i)
+      orderRow(g.callee_edges.data() + g.callee_off[i],
+               g.callee_order.data() + g.callee_off[i],
+               g.callee_off[i+1] - g.callee_off[i]);
+
+    // Condense the graph: the calls between components
+    g.n_sccs = findSCCs(n_fns, g.callee_off, g.callee_edges, g.scc);
+    groupSCCs(g);
+    callsBetween(g.scc, g.scc_fn_off, g.scc_fns, g.callee_off,
+                 g.callee_edges, edges);
+    buildCSR(edges, g.n_sccs, false, g.scc_succ_off, g.scc_succs);
+    buildCSR(edges, g.n_sccs, true, g.scc_pred_off, g.scc_preds);
+}
+
+// Lay the graph out by patching _prev, whose files added by addFileFrom
+// (_file_prev) are unchanged.  Functions are matched up by name.  Which
+// function a call goes to depends on every definition of its name, so the
+// functions rebuilt are: those sharing a name with one defined in a changed
+// file, or in a file that went away; new ones; and those that call any of
+// these in either version.  The rest keep their edges, counts and rankings,
+// and only the lists of callers, and rankings, that those touch are done
+// again.  Components that lost a function, or an edge of a rebuilt one,
+// are checked to still hold together, and the components are then found
+// on the graph of the components, with those that came apart split up.
+//
+// Returns false, leaving the graph to build(), if there is nothing to patch
+// or most of it changed.
+bool CSDBBuilder::patch(CSDBParts &g)
+{
+    const CSDB *prev = _prev;
+    const CSFnId none = UINT32_MAX;
+    const size_t n_fns = g.n_fns, n_files = _file_name.size();
+    size_t n_prev, reused = 0;
+    uint32_t last = CSDB_NO_FILE;
+    bool same = true; // Whether ids are unchanged
+
+    if (!prev)
+      return false;
+
+    // The files kept must be most of the graph, in their old order
+    for (size_t f=0; f<n_files; ++f) {
+        if (_file_prev[f] == CSDB_NO_FILE)
+          continue;
+        if (last != CSDB_NO_FILE && _file_prev[f] <= last)
+          return false;
+        last = _file_prev[f];
+        reused += _file_def_off[f+1] - _file_def_off[f];
+    }
+    if (last == CSDB_NO_FILE || reused * 2 < _defs.size())
+      return false;
+
+    // fmap takes _prev's ids to ours, pmap back
+    n_prev = prev->getFunctionCount();
+    std::vector<CSFnId> fmap(n_prev, none), pmap(n_fns, none);
+    for (CSFnId p=0; p<n_prev; ++p) {
+        uint32_t id;
+        if (_prev_name[p] && prev->getBaseFunction(p) == p)
+          id = _prev_name[p] - 1;
+        else if (!_names.find(prev->getName(p), &id))
+          continue;
+        fmap[p] = id;
+        pmap[id] = p;
+        same = same && id == p;
+    }
+
+    // Copy _prev's list 'r' to 'out' in our ids, failing if one went away
+    auto renumber = [&](CSRange r, CSFnId *out) {
+        if (same) {
+            std::copy(r.begin(), r.end(), out);
+            return true;
+        }
+        for (auto p: r)
+          if ((*out++ = fmap[p]) == none)
+            return false;
+        return true;
+    };
+
+    // The clean functions from 'fn' whose rows are copied from _prev at
+    // once: while ids are unchanged a run of them is contiguous there as it
+    // is here, otherwise it is just 'fn'
+    auto cleanRun = [&](const std::vector<bool> &redo, CSFnId fn) {
+        CSFnId end = fn + 1;
+        if (same)
+          while (end < n_fns && !redo[end])
+            ++end;
+        return end;
+    };
+    auto copyRows = [&](CSRange (CSDB::*get)(CSFnId) const, CSFnId fn,
+                        CSFnId end, CSFnId *out) {
+        CSRange r = {(prev->*get)(pmap[fn]).first,
+                     (prev->*get)(pmap[end - 1]).last};
+        return renumber(r, out);
+    };
+
+    // Names defined in changed files, or in the files they replaced
+    std::vector<bool> kept(prev->getFileCount()), dirty_name(n_fns);
+    for (size_t f=0; f<n_files; ++f) {
+        if (_file_prev[f] != CSDB_NO_FILE)
+          kept[_file_prev[f]] = true;
+        else
+          for (auto d=_file_def_off[f]; d<_file_def_off[f+1]; ++d)
+            dirty_name[_defs[d]] = true;
+    }
+    for (size_t f=0; f<kept.size(); ++f) {
+        if (kept[f])
+          continue;
+        for (auto d=prev->getFileDefs(f); d<prev->getFileDefs(f+1); ++d) {
+            CSFnId id = fmap[prev->getBaseFunction(prev->getDefFunction(d))];
+            if (id != none)
+              dirty_name[id] = true;
+        }
+    }
+
+    std::vector<bool> dirty(n_fns);
+    for (CSFnId fn=0; fn<n_fns; ++fn)
+      if (dirty_name[g.fn_base[fn]] || pmap[fn] == none)
+        dirty[fn] = true;
+    for (CSFnId p=0; p<n_prev; ++p) {
+        CSFnId id = fmap[p];
+        if (id != none && !dirty_name[g.fn_base[id]])
+          continue;
+        for (auto caller: prev->getCallers(p))
+          if (fmap[caller] != none)
+            dirty[fmap[caller]] = true;
+    }
+
+    // Rebuild the edges of those from their first definitions
+    std::vector<uint64_t> provider(n_fns, UINT64_MAX);
+    for (size_t d=g.defs.size(); d-- > 0; )
+      provider[g.defs[d]] = d;
+
+    std::vector<CSFnId> fns, rows; // Rebuilt functions, their callees
+    std::vector<uint64_t> row_off(1, 0);
+    std::vector<uint32_t> counts;
+    std::vector<uint64_t> at(n_fns, UINT64_MAX);
+    for (CSFnId fn=0; fn<n_fns; ++fn) {
+        size_t start = rows.size(), d = provider[fn];
+        if (!dirty[fn])
+          continue;
+        fns.push_back(fn);
+        if (d == UINT64_MAX) { // Only called
+            row_off.push_back(rows.size());
+            continue;
+        }
+        for (auto c=_def_call_off[d]; c<_def_call_off[d+1]; ++c) {
+            CSFnId to = g.calls[c];
+            if (at[to] != UINT64_MAX && at[to] >= start)
+              ++counts[at[to]];
+            else {
+                at[to] = rows.size();
+                rows.push_back(to);
+                counts.push_back(1);
+            }
+        }
+        row_off.push_back(rows.size());
+    }
+
+    // Callees: the rebuilt rows, and everyone else's renumbered
+    size_t k = 0;
+    g.callee_off.assign(n_fns + 1, 0);
+    for (CSFnId fn=0; fn<n_fns; ++fn) {
+        size_t len = dirty[fn] ? row_off[k+1] - row_off[k] :
+                                 prev->getCallees(pmap[fn]).size();
+        k += dirty[fn];
+        g.callee_off[fn+1] = g.callee_off[fn] + len;
+    }
+    g.callee_edges.resize(g.callee_off[n_fns]);
+    g.callee_count.resize(g.callee_off[n_fns]);
+    k = 0;
+    for (CSFnId fn=0; fn<n_fns; ++fn) {
+        auto o = g.callee_off[fn];
+        if (dirty[fn]) {
+            std::copy(rows.begin() + row_off[k], rows.begin() + row_off[k+1],
+                      g.callee_edges.begin() + o);
+            std::copy(counts.begin() + row_off[k],
+                      counts.begin() + row_off[k+1],
+                      g.callee_count.begin() + o);
+            ++k;
+            continue;
+        }
+        CSFnId end = cleanRun(dirty, fn);
+        const uint32_t *n = prev->getCalleeCounts(pmap[fn]);
+        if (!copyRows(&CSDB::getCallees, fn, end, g.callee_edges.data() + o))
+          return false;
+        std::copy(n, n + g.callee_off[end] - o, g.callee_count.begin() + o);
+        fn = end - 1;
+    }
+
+    // Orders of the callees: a clean row's positions still are in order
+    // unless its callees were renumbered out of it
+    g.callee_order.resize(g.callee_off[n_fns]);
+    for (CSFnId fn=0; fn<n_fns; ++fn) {
+        const CSFnId *row = g.callee_edges.data() + g.callee_off[fn];
+        uint32_t *order = g.callee_order.data() + g.callee_off[fn];
+        size_t len = g.callee_off[fn+1] - g.callee_off[fn];
+        if (dirty[fn]) {
+            orderRow(row, order, len);
+            continue;
+        }
+        CSFnId end = cleanRun(dirty, fn);
+        const uint32_t *p = prev->getCalleeOrder(pmap[fn]);
+        std::copy(p, p + g.callee_off[end] - g.callee_off[fn], order);
+        if (!same)
+          for (size_t i=1; i<len; ++i)
+            if (row[order[i-1]] > row[order[i]]) {
+                orderRow(row, order, len);
+                break;
+            }
+        fn = end - 1;
+    }
+
+    // Callers: the lists of the functions that rebuilt ones call or used
+    // to call, or that functions that went away called, are regrouped.
+    // Callers come in the order of the definitions providing their edges.
+    std::vector<bool> regroup(n_fns);
+    auto regroupPrev = [&](CSFnId p) {
+        for (auto callee: prev->getCallees(p))
+          if (fmap[callee] != none)
+            regroup[fmap[callee]] = true;
+    };
+    std::vector<std::pair<CSFnId, CSFnId>> fresh; // (callee, rebuilt caller)
+    for (auto fn: fns) {
+        regroup[fn] = true;
+        for (auto e=g.callee_off[fn]; e<g.callee_off[fn+1]; ++e) {
+            regroup[g.callee_edges[e]] = true;
+            fresh.push_back(std::make_pair(g.callee_edges[e], fn));
+        }
+        if (pmap[fn] != none)
+          regroupPrev(pmap[fn]);
+    }
+    for (CSFnId p=0; p<n_prev; ++p)
+      if (fmap[p] == none)
+        regroupPrev(p);
+    typedef std::pair<CSFnId, CSFnId> Edge;
+    std::sort(fresh.begin(), fresh.end(), [&](const Edge &a, const Edge &b) {
+        return a.first != b.first ? a.first < b.first :
+                                    provider[a.second] < provider[b.second];
+    });
+
+    std::vector<CSFnId> grouped;
+    auto it = fresh.begin();
+    g.caller_off.assign(n_fns + 1, 0);
+    for (CSFnId fn=0; fn<n_fns; ++fn) {
+        size_t start = grouped.size();
+        if (!regroup[fn]) {
+            g.caller_off[fn+1] = g.caller_off[fn] +
+                                 prev->getCallers(pmap[fn]).size();
+            continue;
+        }
+        auto end = it;
+        while (end != fresh.end() && end->first == fn)
+          ++end;
+        if (pmap[fn] != none) {
+            for (auto p: prev->getCallers(pmap[fn])) {
+                CSFnId caller = fmap[p];
+                if (caller == none || dirty[caller])
+                  continue;
+                for ( ; it != end && provider[it->second] < provider[caller];
+                     ++it)
+                  grouped.push_back(it->second);
+                grouped.push_back(caller);
+            }
+        }
+        for ( ; it != end; ++it)
+          grouped.push_back(it->second);
+        g.caller_off[fn+1] = g.caller_off[fn] + grouped.size() - start;
+    }
+    g.caller_edges.resize(g.caller_off[n_fns]);
+    k = 0;
+    for (CSFnId fn=0; fn<n_fns; ++fn) {
+        auto o = g.caller_off[fn], len = g.caller_off[fn+1] - o;
+        if (regroup[fn]) {
+            std::copy(grouped.begin() + k, grouped.begin() + k + len,
+                      g.caller_edges.begin() + o);
+            k += len;
+            continue;
+        }
+        CSFnId end = cleanRun(regroup, fn);
+        if (!copyRows(&CSDB::getCallers, fn, end, g.caller_edges.data() + o))
+          return false;
+        fn = end - 1;
+    }
+
+    // Rankings: a list is ranked again if it changed, or if one of its
+    // functions' own number of callees (or callers) did.  Rebuilt lists
+    // often come out as they were, a caller list always does for a callee
+    // that the rebuilt function still calls.
+    auto changed = [&](const std::vector<bool>     &rebuilt,
+                       const std::vector<uint64_t> &off,
+                       const std::vector<CSFnId>   &edges,
+                       CSRange (CSDB::*get)(CSFnId) const) {
+        std::vector<bool> redo(rebuilt);
+        for (CSFnId fn=0; fn<n_fns; ++fn) {
+            if (!redo[fn] || pmap[fn] == none)
+              continue;
+            CSRange r = (prev->*get)(pmap[fn]);
+            redo[fn] = r.size() != off[fn+1] - off[fn] ||
+                       !std::equal(r.begin(), r.end(), edges.begin() + off[fn],
+                                   [&](CSFnId p, CSFnId id) {
+                                       return fmap[p] == id;
+                                   });
+        }
+        return redo;
+    };
+    auto rank_callees = changed(dirty, g.callee_off, g.callee_edges,
+                                &CSDB::getCallees);
+    auto rank_callers = changed(regroup, g.caller_off, g.caller_edges,
+                                &CSDB::getCallers);
+    for (CSFnId fn=0; fn<n_fns; ++fn) {
+        CSFnId p = pmap[fn];
+        if (p == none || g.callee_off[fn+1] - g.callee_off[fn] !=
+                         prev->getCallees(p).size())
+          for (auto e=g.caller_off[fn]; e<g.caller_off[fn+1]; ++e)
+            rank_callees[g.caller_edges[e]] = true;
+        if (p == none || g.caller_off[fn+1] - g.caller_off[fn] !=
+                         prev->getCallers(p).size())
+          for (auto e=g.callee_off[fn]; e<g.callee_off[fn+1]; ++e)
+            rank_callers[g.callee_edges[e]] = true;
+    }
+    auto rank = [&](const std::vector<uint64_t> &off,
+                    const std::vector<CSFnId>   &edges,
+                    const std::vector<bool>     &redo,
+                    bool                         callers,
+                    std::vector<CSFnId>         &ranked) {
+        ranked.resize(edges.size());
+        for (CSFnId fn=0; fn<n_fns; ++fn) {
+            CSFnId *first = ranked.data() + off[fn];
+            if (redo[fn]) {
+                std::copy(edges.begin() + off[fn], edges.begin() + off[fn+1],
+                          first);
+                rankRow(off, first, ranked.data() + off[fn+1]);
+                continue;
+            }
+            CSFnId end = cleanRun(redo, fn);
+            if (!copyRows(callers ? &CSDB::getCallersRanked :
+                                    &CSDB::getCalleesRanked, fn, end, first))
+              return false;
+            fn = end - 1;
+        }
+        return true;
+    };
+    if (!rank(g.callee_off, g.callee_edges, rank_callees, false,
+              g.callee_ranked) ||
+        !rank(g.caller_off, g.caller_edges, rank_callers, true,
+              g.caller_ranked))
+      return false;
+
+    // Components: one that lost a function must still reach each of the
+    // rest from any one both ways, and one that lost a call between two of
+    // its functions must still make it some other way.  Those that do not
+    // come apart into their functions.
+    const size_t n_prev_sccs = prev->getSccCount();
+    std::vector<CSSccId> was(n_fns, UINT32_MAX); // Old component of each
+    std::vector<uint8_t> state(n_prev_sccs); // 1: lost a function, 2: apart
+    for (CSFnId fn=0; fn<n_fns; ++fn)
+      if (pmap[fn] != none)
+        was[fn] = prev->getScc(pmap[fn]);
+    for (CSFnId p=0; p<n_prev; ++p)
+      if (fmap[p] == none)
+        state[prev->getScc(p)] = 1;
+
+    std::vector<uint32_t> seen(n_fns), seen_back(n_fns);
+    std::vector<CSFnId> members, queue, back, level;
+    uint32_t stamp = 0;
+    auto reachesAll = [&](CSSccId c, const std::vector<uint64_t> &off,
+                          const std::vector<CSFnId> &edges) {
+        queue.assign(1, members[0]);
+        seen[members[0]] = ++stamp;
+        for (size_t i=0; i<queue.size(); ++i) {
+            CSFnId fn = queue[i];
+            for (auto e=off[fn]; e<off[fn+1]; ++e) {
+                CSFnId to = edges[e];
+                if (was[to] == c && seen[to] != stamp) {
+                    seen[to] = stamp;
+                    queue.push_back(to);
+                }
+            }
+        }
+        return queue.size() == members.size();
+    };
+    // Search from both ends at once, a level of the smaller side at a time
+    auto reaches = [&](CSSccId c, CSFnId from, CSFnId to) {
+        ++stamp;
+        seen[from] = seen_back[to] = stamp;
+        queue.assign(1, from);
+        back.assign(1, to);
+        while (!queue.empty() && !back.empty()) {
+            bool fwd = queue.size() <= back.size();
+            auto &off = fwd ? g.callee_off : g.caller_off;
+            auto &edges = fwd ? g.callee_edges : g.caller_edges;
+            auto &mine = fwd ? seen : seen_back;
+            auto &theirs = fwd ? seen_back : seen;
+            level.clear();
+            for (auto fn: fwd ? queue : back) {
+                for (auto e=off[fn]; e<off[fn+1]; ++e) {
+                    CSFnId x = edges[e];
+                    if (was[x] != c || mine[x] == stamp)
+                      continue;
+                    if (theirs[x] == stamp)
+                      return true;
+                    mine[x] = stamp;
+                    level.push_back(x);
+                }
+            }
+            (fwd ? queue : back).swap(level);
+        }
+        return false;
+    };
+    for (CSSccId c=0; c<n_prev_sccs; ++c) {
+        if (state[c] != 1)
+          continue;
+        members.clear();
+        for (auto p: prev->getSccFunctions(c))
+          if (fmap[p] != none)
+            members.push_back(fmap[p]);
+        if (members.size() > 1 &&
+            (!reachesAll(c, g.callee_off, g.callee_edges) ||
+             !reachesAll(c, g.caller_off, g.caller_edges)))
+          state[c] = 2;
+    }
+    std::vector<CSFnId> row_of(n_fns, none); // Whose new callee each is
+    for (auto fn: fns) {
+        CSFnId p = pmap[fn];
+        if (p == none || state[was[fn]])
+          continue;
+        for (auto e=g.callee_off[fn]; e<g.callee_off[fn+1]; ++e)
+          row_of[g.callee_edges[e]] = fn;
+        for (auto callee: prev->getCallees(p)) {
+            CSFnId to = fmap[callee];
+            if (to != none && was[to] == was[fn] && row_of[to] != fn &&
+                !reaches(was[fn], fn, to)) {
+                state[was[fn]] = 2;
+                break;
+            }
+        }
+    }
+
+    // The graph of what holds together: a node for each old component,
+    // and one for each function that is new or whose component came apart
+    std::vector<uint32_t> node(n_fns), comp_node(n_prev_sccs, UINT32_MAX);
+    std::vector<std::pair<CSFnId, CSFnId>> pairs;
+    std::vector<uint64_t> node_off, succ_off;
+    std::vector<CSFnId> node_fns, succs;
+    std::vector<CSSccId> node_scc;
+    uint32_t n_nodes = 0;
+    for (CSFnId fn=0; fn<n_fns; ++fn) {
+        CSSccId c = was[fn];
+        if (c == UINT32_MAX || state[c] == 2)
+          node[fn] = n_nodes++;
+        else {
+            if (comp_node[c] == UINT32_MAX)
+              comp_node[c] = n_nodes++;
+            node[fn] = comp_node[c];
+        }
+        pairs.push_back(std::make_pair(node[fn], fn));
+    }
+    buildCSR(pairs, n_nodes, false, node_off, node_fns);
+
+    callsBetween(node, node_off, node_fns, g.callee_off, g.callee_edges,
+                 pairs);
+    buildCSR(pairs, n_nodes, false, succ_off, succs);
+    g.n_sccs = findSCCs(n_nodes, succ_off, succs, node_scc);
+    g.scc.resize(n_fns);
+    for (CSFnId fn=0; fn<n_fns; ++fn)
+      g.scc[fn] = node_scc[node[fn]];
+    groupSCCs(g);
+
+    // The calls between components are those between their nodes
+    pairs.clear();
+    for (uint32_t v=0; v<n_nodes; ++v)
+      pairs.push_back(std::make_pair(node_scc[v], v));
+    buildCSR(pairs, g.n_sccs, false, node_off, node_fns);
+    callsBetween(node_scc, node_off, node_fns, succ_off, succs, pairs);
+    buildCSR(pairs, g.n_sccs, false, g.scc_succ_off, g.scc_succs);
+    buildCSR(pairs, g.n_sccs, true, g.scc_pred_off, g.scc_preds);
+
+    // Names keep their order, with the new ones merged in
+    std::vector<CSFnId> added;
+    auto byName = [this](CSFnId a, CSFnId b) {
+        return _names.get(a) < _names.get(b);
+    };
+    for (CSFnId fn=0; fn<n_fns; ++fn)
+      if (pmap[fn] == none)
+        added.push_back(fn);
+    std::sort(added.begin(), added.end(), byName);
+    g.sorted.clear();
+    g.sorted.reserve(n_fns);
+    auto next = added.begin();
+    for (auto p: prev->getPrefix("")) {
+        CSFnId fn = fmap[p];
+        if (fn == none)
+          continue;
+        for ( ; next != added.end() && byName(*next, fn); ++next)
+          g.sorted.push_back(*next);
+        g.sorted.push_back(fn);
+    }
+    g.sorted.insert(g.sorted.end(), next, added.end());
+    return true;
+}
+
+CSDB *CSDBBuilder::finish(const CSDBSource &src)
+{
+    size_t n_fns, len = 0;
+    CSDBParts g;
+    std::vector<char> strtab;
+    std::vector<uint32_t> name_off, fn_file, def_file;
+    std::vector<CSDBFile> files(_file_hash.size());
+    std::vector<uint64_t> file_name_off(_file_names.size());
+
+    // Copies of functions defined in several files add names
+    resolve(g.defs, g.calls, g.fn_base);
+    n_fns = g.n_fns = _names.size();
+
+    for (CSFnId i=0; i<n_fns; ++i)
+      len += _names.get(i).size() + 1;
+    for (uint32_t i=0; i<_file_names.size(); ++i)
+      len += _file_names.get(i).size() + 1;
+
+    // Function names, then file names
+    strtab.reserve(len + 1);
+    name_off.reserve(n_fns);
+    for (CSFnId i=0; i<n_fns; ++i) {
+        auto name = _names.get(i);
+        name_off.push_back(strtab.size());
+        strtab.insert(strtab.end(), name.begin(), name.end());
+        strtab.push_back('\0');
+    }
+    for (uint32_t i=0; i<_file_names.size(); ++i) {
+        auto name = _file_names.get(i);
+        file_name_off[i] = strtab.size();
+        strtab.insert(strtab.end(), name.begin(), name.end());
+        strtab.push_back('\0');
+    }
+    if (strtab.empty())
+      strtab.push_back('\0');
+
+    for (size_t i=0; i<files.size(); ++i) {
+        files[i].hash = _file_hash[i];
+        files[i].name = file_name_off[_file_name[i]];
+    }
+
+    if (patch(g))
+      ++cs_stats.patches;
+    else
+      build(g, strtab, name_off);
+
+    // The first file to define a function provides its calls
+    fn_file.assign(n_fns, CSDB_NO_FILE);
+    def_file.resize(g.defs.size());
+    for (size_t f=files.size(); f-- > 0; ) {
+        for (auto d=_file_def_off[f]; d<_file_def_off[f+1]; ++d) {
+            fn_file[g.defs[d]] = f;
+            def_file[d] = f;
+        }
+    }
+
+    CSDBWriter w;
+    auto hdr = w.getHeader();
+    memcpy(hdr->magic, CSDB_MAGIC, sizeof(hdr->magic));
+    hdr->version = CSDB_VERSION;
+    hdr->n_functions = n_fns;
+    hdr->n_edges = g.callee_edges.size();
+    hdr->n_files = files.size();
+    hdr->n_defs = _defs.size();
+    hdr->n_calls = _def_calls.size();
+    hdr->n_sccs = g.n_sccs;
+    hdr->n_scc_edges = g.scc_succs.size();
+    hdr->src = src;
+    w.add(CSDB_STRTAB, strtab);
+    w.add(CSDB_NAME_OFF, name_off);
+    w.add(CSDB_SORTED, g.sorted);
+    w.add(CSDB_CALLEE_OFF, g.callee_off);
+    w.add(CSDB_CALLEE_EDGES, g.callee_edges);
+    w.add(CSDB_CALLER_OFF, g.caller_off);
+    w.add(CSDB_CALLER_EDGES, g.caller_edges);
+    w.add(CSDB_FILES, files);
+    w.add(CSDB_FILE_DEF_OFF, _file_def_off);
+    w.add(CSDB_DEFS, g.defs);
+    w.add(CSDB_DEF_CALL_OFF, _def_call_off);
+    w.add(CSDB_DEF_CALLS, g.calls);
+    w.add(CSDB_SCC, g.scc);
+    w.add(CSDB_SCC_FN_OFF, g.scc_fn_off);
+    w.add(CSDB_SCC_FNS, g.scc_fns);
+    w.add(CSDB_SCC_SUCC_OFF, g.scc_succ_off);
+    w.add(CSDB_SCC_SUCCS, g.scc_succs);
+    w.add(CSDB_SCC_PRED_OFF, g.scc_pred_off);
+    w.add(CSDB_SCC_PREDS, g.scc_preds);
+    w.add(CSDB_CALLEE_RANK, g.callee_ranked);
+    w.add(CSDB_CALLER_RANK, g.caller_ranked);
+    w.add(CSDB_FN_FILE, fn_file);
+    w.add(CSDB_DEF_FILE, def_file);
+    w.add(CSDB_DEF_LINE, _def_line);
+    w.add(CSDB_DEF_FLAGS, _def_flags);
+    w.add(CSDB_CALL_LINE, _call_line);
+    w.add(CSDB_CALLEE_COUNT, g.callee_count);
+    w.add(CSDB_FN_BASE, g.fn_base);
+    w.add(CSDB_CALLEE_ORDER, g.callee_order);
+
+    auto db = new CSDB;
+    db->_image = w.finish();
+    db->setImage(db->_image.data(), db->_image.size() * 8);
+    return db;
+}
+
+static inline uint64_t rotl64(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t fmix64(uint64_t k)
+{
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return k;
+}
+
+// Word at a time, murmur3 style mixing
+uint64_t csHash(const void *data, size_t len)
+{
+    const uint8_t *p = (const uint8_t *)data;
+    uint64_t h = 0x9e3779b97f4a7c15ULL, w;
+    size_t n = len;
+
+    for ( ; n >= 8; p += 8, n -= 8) {
+        memcpy(&w, p, 8);
+        h ^= w * 0x87c37b91114253d5ULL;
+        h = rotl64(h, 31) * 0x4cf5ad432745937fULL;
+    }
+
+    w = 0;
+    memcpy(&w, p, n);
+    h ^= w * 0x87c37b91114253d5ULL;
+    return fmix64(h ^ len);
+}
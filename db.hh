@@ -0,0 +1,366 @@
+//******************************************************************************
+// Copyright (c) 2016, enferex <mattdavis9@gmail.com>
+//
+// ISC License:
+// https://www.isc.org/downloads/software-support-policy/isc-license/
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+// REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+// AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+// OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+//******************************************************************************
+
+#ifndef _DB_HH
+#define _DB_HH
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "arena.hh"
+
+using std::string;
+
+// Functions are numbered 0..n-1 in the call graph
+typedef uint32_t CSFnId;
+
+// Strongly connected components of the call graph, numbered 0..n-1
+typedef uint32_t CSSccId;
+
+// A run of function (or component) ids: the callees or callers of one
+// function
+struct CSRange
+{
+    const CSFnId *first;
+    const CSFnId *last;
+
+    const CSFnId *begin() const { return first; }
+    const CSFnId *end() const { return last; }
+    size_t size() const { return last - first; }
+};
+
+// Sections of a CSDB image
+enum CSDBSection
+{
+    CSDB_STRTAB,       // char[]: NUL terminated names
+    CSDB_NAME_OFF,     // uint32_t[n_functions]: offset of each name in STRTAB
+    CSDB_SORTED,       // CSFnId[n_functions]: ids ordered by name
+    CSDB_CALLEE_OFF,   // uint64_t[n_functions+1]
+    CSDB_CALLEE_EDGES, // CSFnId[n_edges]
+    CSDB_CALLER_OFF,   // uint64_t[n_functions+1]
+    CSDB_CALLER_EDGES, // CSFnId[n_edges]
+    CSDB_FILES,        // CSDBFile[n_files]: cscope.out file sections
+    CSDB_FILE_DEF_OFF, // uint64_t[n_files+1]: definitions of each file
+    CSDB_DEFS,         // CSFnId[n_defs]: function of each definition
+    CSDB_DEF_CALL_OFF, // uint64_t[n_defs+1]: calls of each definition
+    CSDB_DEF_CALLS,    // CSFnId[n_calls]
+    CSDB_SCC,          // CSSccId[n_functions]: component of each function
+    CSDB_SCC_FN_OFF,   // uint64_t[n_sccs+1]: functions of each component
+    CSDB_SCC_FNS,      // CSFnId[n_functions]
+    CSDB_SCC_SUCC_OFF, // uint64_t[n_sccs+1]: components each one calls
+    CSDB_SCC_SUCCS,    // CSSccId[n_scc_edges]
+    CSDB_SCC_PRED_OFF, // uint64_t[n_sccs+1]: components calling each one
+    CSDB_SCC_PREDS,    // CSSccId[n_scc_edges]
+    CSDB_CALLEE_RANK,  // CSFnId[n_edges]: CALLEE_EDGES, ranked (see CSDB)
+    CSDB_CALLER_RANK,  // CSFnId[n_edges]
+    CSDB_FN_FILE,      // uint32_t[n_functions]: file defining each function
+    CSDB_DEF_FILE,     // uint32_t[n_defs]: file of each definition
+    CSDB_DEF_LINE,     // uint32_t[n_defs]: line of each definition
+    CSDB_DEF_FLAGS,    // uint8_t[n_defs]: CSDB_DEF_* of each definition
+    CSDB_CALL_LINE,    // uint32_t[n_calls]: line of each of DEF_CALLS
+    CSDB_CALLEE_COUNT, // uint32_t[n_edges]: calls behind each CALLEE_EDGES
+    CSDB_FN_BASE,      // CSFnId[n_functions]: function each is a copy of
+    CSDB_CALLEE_ORDER, // uint32_t[n_edges]: CALLEE_EDGES rows by id (see CSDB)
+    CSDB_N_SECTIONS
+};
+
+#define CSDB_MAGIC   "FNPLOTDB"
+#define CSDB_NO_FILE UINT32_MAX
+#define CSDB_VERSION 6
+
+// Definition flags
+#define CSDB_DEF_STATIC 0x1
+
+// A function defined in more than one file has a copy for each file but
+// one, named "<name>" CSDB_COPY_SEP "<file>" (see CSDBBuilder::finish)
+#define CSDB_COPY_SEP ":"
+
+// A file section of the cscope database.  Together with the definitions
+// and calls it contributed, this lets a graph be rebuilt without
+// reparsing the sections that did not change.
+struct CSDBFile
+{
+    uint64_t hash; // Fingerprint of the section text
+    uint64_t name; // Offset of the file name in STRTAB
+};
+
+// Identity of the cscope database a graph was built from
+struct CSDBSource
+{
+    uint64_t size;
+    int64_t  mtime;
+    int64_t  mtime_nsec;
+    uint64_t hdr_hash; // Hash of the cscope.out header line
+
+    bool operator==(const CSDBSource &o) const {
+        return size == o.size && mtime == o.mtime &&
+               mtime_nsec == o.mtime_nsec && hdr_hash == o.hdr_hash;
+    }
+};
+
+// A CSDB image starts with this header.  Sections are addressed by byte
+// offset from the start of the image, so an image can be written to disk
+// and mapped back in as is.
+struct CSDBHeader
+{
+    char       magic[8];
+    uint32_t   version;
+    uint32_t   n_functions;
+    uint64_t   n_edges;
+    uint64_t   n_files;
+    uint64_t   n_defs;
+    uint64_t   n_calls;
+    uint64_t   n_sccs;
+    uint64_t   n_scc_edges;
+    uint64_t   size;     // Of the whole image
+    CSDBSource src;
+    struct { uint64_t off, size; } sections[CSDB_N_SECTIONS];
+};
+
+// Call graph in compressed sparse row form.  The callees of function 'i' are
+// callee_edges[callee_off[i] .. callee_off[i+1]), and its callers are
+// found the same way in the caller_* arrays.  Names live in one string
+// table; the sorted section holds the ids ordered by name for lookups.
+//
+// Each function's callees are also kept ranked by how many functions they
+// call in turn, and its callers by how many functions call them, most
+// first, so the neighbours that lead furthest are a prefix of the list.
+//
+// Every definition and call site is kept, with its file and line, in
+// parallel arrays, and each edge (caller, callee) counts the calls it
+// stands for.  Each callee row also lists its positions in order of callee
+// id, so that an edge is found by binary search.
+//
+// The graph is also condensed into its strongly connected components
+// (functions that all reach each other through calls).  The components
+// form a DAG, numbered so that a component only calls components with
+// lower numbers, with its edges in the same CSR form.  A graph patched on
+// reload (see CSDBBuilder) may number them differently from one built
+// afresh.
+//
+// All of it lives in one contiguous image (see CSDBHeader), either built in
+// memory or mapped from a snapshot file.
+class CSDB
+{
+public:
+    ~CSDB();
+    CSDB(const CSDB &) = delete;
+    CSDB &operator=(const CSDB &) = delete;
+
+    // Map the snapshot 'fname'.  Returns NULL if it is not a valid snapshot.
+    static CSDB *load(const char *fname);
+    bool save(const char *fname) const;
+
+    const CSDBSource &getSource() const { return _hdr->src; }
+    size_t getFunctionCount() const { return _hdr->n_functions; }
+    size_t getEdgeCount() const { return _hdr->n_edges; }
+    size_t getDefCount() const { return _hdr->n_defs; }
+    size_t getCallCount() const { return _hdr->n_calls; }
+    const char *getName(CSFnId id) const { return _strtab + _name_off[id]; }
+    bool getId(const char *name, CSFnId *id) const;
+
+    // Ids of the functions whose names start with 'prefix', in name order
+    // (all of them for "")
+    CSRange getPrefix(const char *prefix) const;
+
+    CSRange getCallees(CSFnId id) const {
+        CSRange r = {_callee_edges + _callee_off[id],
+                     _callee_edges + _callee_off[id+1]};
+        return r;
+    }
+
+    CSRange getCallers(CSFnId id) const {
+        CSRange r = {_caller_edges + _caller_off[id],
+                     _caller_edges + _caller_off[id+1]};
+        return r;
+    }
+
+    // How many calls each of getCallees(id) stands for, in the same order
+    const uint32_t *getCalleeCounts(CSFnId id) const {
+        return _callee_count + _callee_off[id];
+    }
+
+    // Positions in getCallees(id) of its callees, in order of their ids
+    const uint32_t *getCalleeOrder(CSFnId id) const {
+        return _callee_order + _callee_off[id];
+    }
+
+    // How many times 'caller' calls 'callee' (0: never).  Binary searches
+    // the caller's callees.
+    uint32_t countCalls(CSFnId caller, CSFnId callee) const;
+
+    // The function a per-file copy is of (see CSDB_COPY_SEP), or 'id' itself
+    CSFnId getBaseFunction(CSFnId id) const { return _fn_base[id]; }
+
+    // The same, ranked
+    CSRange getCalleesRanked(CSFnId id) const {
+        CSRange r = {_callee_ranked + _callee_off[id],
+                     _callee_ranked + _callee_off[id+1]};
+        return r;
+    }
+
+    CSRange getCallersRanked(CSFnId id) const {
+        CSRange r = {_caller_ranked + _caller_off[id],
+                     _caller_ranked + _caller_off[id+1]};
+        return r;
+    }
+
+    // Per-file contributions: file 'f' defined [getFileDefs(f), ...(f+1)),
+    // and definition 'd' is of function getDefFunction(d).  Definition 'd'
+    // is at line getDefLine(d) of file getDefFile(d), and makes the calls
+    // getDefCalls(d), in order, at the lines getDefCallLines(d).
+    size_t getFileCount() const { return _hdr->n_files; }
+    const char *getFileName(size_t f) const {
+        return _strtab + _files[f].name;
+    }
+    uint64_t getFileHash(size_t f) const { return _files[f].hash; }
+    uint64_t getFileDefs(size_t f) const { return _file_def_off[f]; }
+    // The file whose definition of 'id' provides its calls, or CSDB_NO_FILE
+    // if it is only ever called
+    uint32_t getFunctionFile(CSFnId id) const { return _fn_file[id]; }
+    uint32_t getDefFile(uint64_t d) const { return _def_file[d]; }
+    uint32_t getDefLine(uint64_t d) const { return _def_line[d]; }
+    bool isDefStatic(uint64_t d) const {
+        return _def_flags[d] & CSDB_DEF_STATIC;
+    }
+    CSFnId getDefFunction(uint64_t d) const { return _defs[d]; }
+    CSRange getDefCalls(uint64_t d) const {
+        CSRange r = {_def_calls + _def_call_off[d],
+                     _def_calls + _def_call_off[d+1]};
+        return r;
+    }
+    const uint32_t *getDefCallLines(uint64_t d) const {
+        return _call_line + _def_call_off[d];
+    }
+
+    // Condensation: the component of each function, its functions, and
+    // the (distinct) components it calls and is called from
+    size_t getSccCount() const { return _hdr->n_sccs; }
+    CSSccId getScc(CSFnId id) const { return _scc[id]; }
+    CSRange getSccFunctions(CSSccId c) const {
+        CSRange r = {_scc_fns + _scc_fn_off[c], _scc_fns + _scc_fn_off[c+1]};
+        return r;
+    }
+    CSRange getSccCallees(CSSccId c) const {
+        CSRange r = {_scc_succs + _scc_succ_off[c],
+                     _scc_succs + _scc_succ_off[c+1]};
+        return r;
+    }
+    CSRange getSccCallers(CSSccId c) const {
+        CSRange r = {_scc_preds + _scc_pred_off[c],
+                     _scc_preds + _scc_pred_off[c+1]};
+        return r;
+    }
+
+private:
+    friend class CSDBBuilder;
+
+    std::vector<uint64_t> _image;    // Owned image (empty if mapped)
+    void                 *_map;      // Mapped image
+    size_t                _map_size;
+    const CSDBHeader     *_hdr;
+    const char           *_strtab;
+    const uint32_t       *_name_off;
+    const CSFnId         *_sorted;
+    const uint64_t       *_callee_off;
+    const CSFnId         *_callee_edges;
+    const uint64_t       *_caller_off;
+    const CSFnId         *_caller_edges;
+    const CSDBFile       *_files;
+    const uint64_t       *_file_def_off;
+    const CSFnId         *_defs;
+    const uint64_t       *_def_call_off;
+    const CSFnId         *_def_calls;
+    const CSSccId        *_scc;
+    const uint64_t       *_scc_fn_off;
+    const CSFnId         *_scc_fns;
+    const uint64_t       *_scc_succ_off;
+    const CSSccId        *_scc_succs;
+    const uint64_t       *_scc_pred_off;
+    const CSSccId        *_scc_preds;
+    const CSFnId         *_callee_ranked;
+    const CSFnId         *_caller_ranked;
+    const uint32_t       *_fn_file;
+    const uint32_t       *_def_file;
+    const uint32_t       *_def_line;
+    const uint8_t        *_def_flags;
+    const uint32_t       *_call_line;
+    const uint32_t       *_callee_count;
+    const CSFnId         *_fn_base;
+    const uint32_t       *_callee_order;
+
+    CSDB() : _map(nullptr), _map_size(0), _hdr(nullptr) {}
+    bool setImage(const void *image, size_t size);
+    bool validate() const;
+};
+
+// Collects file sections, their function definitions and the calls those
+// make, then lays them out as a CSDB.  Definitions belong to the last added
+// file, and everything is recorded by name until finish() works out which
+// function each definition and call is of.  The first definition of a
+// function provides its edges; later ones are only recorded in the file
+// table.
+//
+// Given the graph 'prev' that a reload replaces, the files added from it
+// with addFileFrom are the unchanged ones, and finish() patches the parts
+// of 'prev' that the other files touch rather than laying everything out
+// again (see patch()).  'prev' must outlive the builder.
+struct CSDBParts;
+class CSDBBuilder
+{
+public:
+    CSDBBuilder(const CSDB *prev=NULL) :
+        _file_def_off(1, 0), _def_call_off(1, 0), _prev(prev) {}
+
+    void addFile(std::string_view name, uint64_t hash);
+    void addFileFrom(const CSDB *db, size_t f,
+                     std::string_view name=std::string_view());
+    void addFunction(std::string_view name, uint32_t line, bool is_static,
+                     const std::vector<std::string_view> &callees,
+                     const std::vector<uint32_t> &lines);
+    CSDB *finish(const CSDBSource &src);
+
+private:
+    CSStrTab              _names;   // Name ids are CSFnIds
+    CSStrTab              _file_names;
+    std::vector<uint64_t> _file_hash;
+    std::vector<uint32_t> _file_name;
+    std::vector<uint64_t> _file_def_off;
+    std::vector<CSFnId>   _defs;      // By name
+    std::vector<uint32_t> _def_line;
+    std::vector<uint8_t>  _def_flags;
+    std::vector<uint64_t> _def_call_off;
+    std::vector<CSFnId>   _def_calls; // By name
+    std::vector<uint32_t> _call_line;
+    const CSDB           *_prev;
+    std::vector<uint32_t> _file_prev; // File of _prev each file is, if any
+    std::vector<uint32_t> _prev_name; // _prev's function ids -> name id+1
+
+    void resolve(std::vector<CSFnId> &defs, std::vector<CSFnId> &calls,
+                 std::vector<CSFnId> &base);
+    void build(CSDBParts &g, const std::vector<char> &strtab,
+               const std::vector<uint32_t> &name_off);
+    bool patch(CSDBParts &g);
+};
+
+// Fast non-cryptographic hash, for fingerprinting database contents
+extern uint64_t csHash(const void *data, size_t len);
+
+#endif // _DB_HH
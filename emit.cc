@@ -0,0 +1,416 @@
+//******************************************************************************
+// Copyright (c) 2016, enferex <mattdavis9@gmail.com>
+//
+// ISC License:
+// https://www.isc.org/downloads/software-support-policy/isc-license/
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+// REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+// AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+// OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+//******************************************************************************
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstring>
+#include <string>
+#include "emit.hh"
+#include "stats.hh"
+
+// Collects output, writing it to 'out' CS_EMIT_BUFSZ at a time instead of a
+// stdio call per piece
+class CSOutBuf
+{
+public:
+    CSOutBuf(FILE *out) : _out(out) { _buf.reserve(CS_EMIT_BUFSZ + 64); }
+    ~CSOutBuf() { flush(); }
+
+    void put(const char *s, size_t len) {
+        _buf.append(s, len);
+        if (_buf.size() >= CS_EMIT_BUFSZ)
+          flush();
+    }
+
+    void put(const char *s) { put(s, strlen(s)); }
+
+    void put(char c) {
+        _buf.push_back(c);
+        if (_buf.size() >= CS_EMIT_BUFSZ)
+          flush();
+    }
+
+    void putNumber(uint64_t n) {
+        char tmp[24];
+        put(tmp, std::to_chars(tmp, tmp + sizeof(tmp), n).ptr - tmp);
+    }
+
+    void putVarint(uint64_t n) {
+        while (n >= 0x80) {
+            _buf.push_back((char)(n | 0x80));
+            n >>= 7;
+        }
+        put((char)n);
+    }
+
+    // Length prefixed, for the binary format
+    void putString(const char *s) {
+        size_t len = strlen(s);
+        putVarint(len);
+        put(s, len);
+    }
+
+    // Quoted and escaped, for json
+    void putJSON(const char *s) {
+        size_t len = strlen(s);
+        put('"');
+        if (std::none_of(s, s + len, [](unsigned char c) {
+                return c == '"' || c == '\\' || c < 0x20;
+            })) {
+            put(s, len);
+            put('"');
+            return;
+        }
+        for ( ; *s; ++s) {
+            unsigned char c = *s;
+            if (c == '"' || c == '\\') {
+                put('\\');
+                put((char)c);
+            }
+            else if (c < 0x20) {
+                char tmp[8];
+                put(tmp, snprintf(tmp, sizeof(tmp), "\\u%04x", c));
+            }
+            else
+              put((char)c);
+        }
+        put('"');
+    }
+
+    void flush() {
+        if (!_buf.empty())
+          fwrite(_buf.data(), 1, _buf.size(), _out);
+        _buf.clear();
+    }
+
+private:
+    FILE        *_out;
+    std::string  _buf;
+};
+
+bool csParseFormat(const char *name, CSFormat *format)
+{
+    if (!strcmp(name, "dot"))
+      *format = CS_FORMAT_DOT;
+    else if (!strcmp(name, "json"))
+      *format = CS_FORMAT_JSON;
+    else if (!strcmp(name, "binary"))
+      *format = CS_FORMAT_BINARY;
+    else
+      return false;
+    return true;
+}
+
+const char *csFormatExt(CSFormat format)
+{
+    switch (format) {
+    case CS_FORMAT_JSON: return ".json";
+    case CS_FORMAT_BINARY: return ".bin";
+    default: return ".dot";
+    }
+}
+
+// Node names for the emitters: functions of a graph, or a list of names
+struct CSFnNames
+{
+    const CSDB *db;
+
+    size_t size() const { return db->getFunctionCount(); }
+    const char *operator()(CSFnId id) const { return db->getName(id); }
+};
+
+struct CSListNames
+{
+    const std::vector<std::string> &names;
+
+    size_t size() const { return names.size(); }
+    const char *operator()(uint32_t id) const { return names[id].c_str(); }
+};
+
+// Write 's' as a quoted dot string
+static void putDotString(CSOutBuf &buf, const char *s)
+{
+    buf.put('"');
+    for ( ; *s; ++s) {
+        if (*s == '"' || *s == '\\')
+          buf.put('\\');
+        buf.put(*s);
+    }
+    buf.put('"');
+}
+
+// Names that are not plain identifiers (file names, say) need quoting in dot
+static void putDotID(CSOutBuf &buf, const char *name)
+{
+    const char *c;
+
+    for (c=name; *c && (isalnum((unsigned char)*c) || *c == '_'); ++c)
+      ;
+    if (!*c && *name && !isdigit((unsigned char)*name)) {
+        buf.put(name, c - name);
+        return;
+    }
+
+    putDotString(buf, name);
+}
+
+template <typename Names>
+static void emitDot(
+    CSOutBuf                  &buf,
+    const Names               &name,
+    const char                *title,
+    const CSEdgeList          &edges,
+    const std::vector<CSFnId> &nodes,
+    const char                *truncated,
+    const CSDB                *counts)
+{
+    buf.put("digraph ");
+    putDotString(buf, title);
+    buf.put(" {\n");
+    for (auto id: nodes) {
+        buf.put("    ");
+        putDotID(buf, name(id));
+        buf.put('\n');
+    }
+    for (const auto &e: edges) {
+        buf.put("    ");
+        putDotID(buf, name(e.first));
+        buf.put(" -> ");
+        putDotID(buf, name(e.second));
+        if (counts) {
+            buf.put(" [label=");
+            buf.putNumber(counts->countCalls(e.first, e.second));
+            buf.put(']');
+        }
+        buf.put('\n');
+    }
+    if (truncated) {
+        buf.put("    // truncated: ");
+        buf.put(truncated);
+        buf.put('\n');
+    }
+    buf.put("}\n");
+}
+
+// The json and binary formats list the nodes once and refer to them by
+// index: 'order' gets the nodes in order of first appearance, and 'index'
+// (by node id) each one's position in it.
+static void numberNodes(
+    size_t                     n_ids,
+    const CSEdgeList          &edges,
+    const std::vector<CSFnId> &nodes,
+    std::vector<CSFnId>       &order,
+    std::vector<uint32_t>     &index)
+{
+    auto add = [&](CSFnId id) {
+        if (index[id] == UINT32_MAX) {
+            index[id] = order.size();
+            order.push_back(id);
+        }
+    };
+
+    index.assign(n_ids, UINT32_MAX);
+    for (auto id: nodes)
+      add(id);
+    for (const auto &e: edges) {
+        add(e.first);
+        add(e.second);
+    }
+}
+
+template <typename Names>
+static void emitJSON(
+    CSOutBuf                  &buf,
+    const Names               &name,
+    const char                *title,
+    const CSEdgeList          &edges,
+    const std::vector<CSFnId> &nodes,
+    const char                *truncated,
+    const CSDB                *counts)
+{
+    std::vector<CSFnId> order;
+    std::vector<uint32_t> index;
+
+    numberNodes(name.size(), edges, nodes, order, index);
+    buf.put("{\"graph\": ");
+    buf.putJSON(title);
+    buf.put(", \"nodes\": [");
+    for (size_t i=0; i<order.size(); ++i) {
+        if (i)
+          buf.put(", ");
+        buf.putJSON(name(order[i]));
+    }
+    buf.put("], \"edges\": [");
+    for (size_t i=0; i<edges.size(); ++i) {
+        buf.put(i ? ", [" : "[");
+        buf.putNumber(index[edges[i].first]);
+        buf.put(", ");
+        buf.putNumber(index[edges[i].second]);
+        buf.put(']');
+    }
+    buf.put(']');
+    if (truncated) {
+        buf.put(", \"truncated\": ");
+        buf.putJSON(truncated);
+    }
+    if (counts) {
+        buf.put(", \"counts\": [");
+        for (size_t i=0; i<edges.size(); ++i) {
+            if (i)
+              buf.put(", ");
+            buf.putNumber(counts->countCalls(edges[i].first,
+                                             edges[i].second));
+        }
+        buf.put(']');
+    }
+    buf.put("}\n");
+}
+
+template <typename Names>
+static void emitBinary(
+    CSOutBuf                  &buf,
+    const Names               &name,
+    const char                *title,
+    const CSEdgeList          &edges,
+    const std::vector<CSFnId> &nodes,
+    const char                *truncated)
+{
+    std::vector<CSFnId> order;
+    std::vector<uint32_t> index;
+
+    numberNodes(name.size(), edges, nodes, order, index);
+    buf.put("FNG1", 4);
+    buf.putString(title);
+    buf.putString(truncated ? truncated : "");
+    buf.putVarint(order.size());
+    for (auto id: order)
+      buf.putString(name(id));
+    buf.putVarint(edges.size());
+    for (const auto &e: edges) {
+        buf.putVarint(index[e.first]);
+        buf.putVarint(index[e.second]);
+    }
+}
+
+template <typename Names>
+static void emit(
+    FILE                      *out,
+    CSFormat                   format,
+    const Names               &name,
+    const char                *title,
+    const CSEdgeList          &edges,
+    const std::vector<CSFnId> &nodes,
+    const char                *truncated,
+    const CSDB                *counts)
+{
+    CSPhaseTimer timer(CS_PHASE_OUTPUT);
+    CSOutBuf buf(out);
+
+    switch (format) {
+    case CS_FORMAT_DOT:
+        emitDot(buf, name, title, edges, nodes, truncated, counts);
+        break;
+    case CS_FORMAT_JSON:
+        emitJSON(buf, name, title, edges, nodes, truncated, counts);
+        break;
+    case CS_FORMAT_BINARY:
+        emitBinary(buf, name, title, edges, nodes, truncated);
+        break;
+    }
+}
+
+// Counts are looked up in 'db' as they are written (binary has no room for
+// them)
+void csEmitGraph(
+    FILE                      *out,
+    CSFormat                   format,
+    const CSDB                *db,
+    const char                *title,
+    const CSEdgeList          &edges,
+    const std::vector<CSFnId> &nodes,
+    const char                *truncated,
+    bool                       counts)
+{
+    CSFnNames names = {db};
+    emit(out, format, names, title, edges, nodes, truncated,
+         counts ? db : NULL);
+}
+
+// Every name is a node, whether or not it has edges
+void csEmitNamedGraph(
+    FILE                           *out,
+    CSFormat                        format,
+    const char                     *title,
+    const std::vector<std::string> &names,
+    const CSEdgeList               &edges,
+    const char                     *truncated)
+{
+    CSListNames list = {names};
+    std::vector<CSFnId> nodes(names.size());
+
+    for (size_t i=0; i<nodes.size(); ++i)
+      nodes[i] = i;
+    emit(out, format, list, title, edges, nodes, truncated, NULL);
+}
+
+void csEmitDiff(
+    FILE         *out,
+    const char   *title,
+    const CSDB   *old_db,
+    const CSDB   *new_db,
+    const CSDiff &diff,
+    const char   *truncated)
+{
+    CSPhaseTimer timer(CS_PHASE_OUTPUT);
+    CSOutBuf buf(out);
+
+    auto edges = [&](const CSDB *db, const CSEdgeList &edges,
+                     const char *attrs) {
+        for (const auto &e: edges) {
+            buf.put("    ");
+            putDotID(buf, db->getName(e.first));
+            buf.put(" -> ");
+            putDotID(buf, db->getName(e.second));
+            buf.put(attrs);
+        }
+    };
+    auto nodes = [&](const CSDB *db, const std::vector<CSFnId> &fns,
+                     const char *attrs) {
+        for (auto id: fns) {
+            buf.put("    ");
+            putDotID(buf, db->getName(id));
+            buf.put(attrs);
+        }
+    };
+
+    buf.put("digraph ");
+    putDotString(buf, title);
+    buf.put(" {\n");
+    nodes(new_db, diff.added_fns, " [color=green]\n");
+    nodes(old_db, diff.removed_fns, " [color=red]\n");
+    edges(new_db, diff.added, " [color=green]\n");
+    edges(old_db, diff.removed, " [color=red, style=dashed]\n");
+    if (truncated) {
+        buf.put("    // truncated: ");
+        buf.put(truncated);
+        buf.put('\n');
+    }
+    buf.put("}\n");
+}
@@ -0,0 +1,95 @@
+//******************************************************************************
+// Copyright (c) 2016, enferex <mattdavis9@gmail.com>
+//
+// ISC License:
+// https://www.isc.org/downloads/software-support-policy/isc-license/
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+// REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+// AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+// OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+//******************************************************************************
+
+#ifndef _EMIT_HH
+#define _EMIT_HH
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+#include "db.hh"
+
+// Output is formatted into a buffer and written out this much at a time
+#define CS_EMIT_BUFSZ (1UL << 20)
+
+// Graph output formats (-F)
+//
+// dot:    digraph "<title>" { a -> b ... }
+//         ending with a "// truncated: <why>" comment if it is.  Edges may
+//         be labelled with how many calls they stand for: a -> b [label=2]
+// json:   One object per graph, on a line of its own:
+//             {"graph": "<title>", "nodes": ["a", "b"], "edges": [[0, 1]]}
+//         Edges are (caller, callee) indexes into nodes.  Truncated graphs
+//         also have "truncated": "<why>", and call counts are listed, in
+//         the order of the edges, as "counts": [2].
+// binary: One record per graph, integers as unsigned LEB128 varints and
+//         strings as a varint length followed by the bytes:
+//             "FNG1" title truncated n_nodes name... n_edges (caller callee)...
+//         with edges indexing the nodes as for json, and 'truncated' empty
+//         unless the graph is.
+enum CSFormat
+{
+    CS_FORMAT_DOT,
+    CS_FORMAT_JSON,
+    CS_FORMAT_BINARY
+};
+
+typedef std::vector<std::pair<CSFnId, CSFnId>> CSEdgeList; // (caller, callee)
+
+// What changed between an old and a new call graph, functions being the same
+// if they have the same name.  Ids are those of the graph that has them.
+struct CSDiff
+{
+    CSEdgeList          added;       // Calls only the new graph has
+    CSEdgeList          removed;     // Calls only the old graph has
+    std::vector<CSFnId> added_fns;   // Functions only the new graph has
+    std::vector<CSFnId> removed_fns; // Functions only the old graph has
+};
+
+// Set 'format' from its name ("dot", "json" or "binary").  Returns false for
+// anything else.
+extern bool csParseFormat(const char *name, CSFormat *format);
+
+// File name extension (".dot", ...) for 'format'
+extern const char *csFormatExt(CSFormat format);
+
+// Write graph 'title' of 'db', its 'edges' and any functions in 'nodes' that
+// have no edges, to 'out'.  Nodes are listed in the order they first
+// appear, 'nodes' first.  'truncated' says why the graph is incomplete, or
+// is NULL if it is not.  With 'counts' dot and json give the number of
+// calls behind each edge.
+extern void csEmitGraph(FILE *out, CSFormat format, const CSDB *db,
+                        const char *title, const CSEdgeList &edges,
+                        const std::vector<CSFnId> &nodes,
+                        const char *truncated=NULL, bool counts=false);
+
+// The same for a graph of named nodes other than functions, its 'edges'
+// indexing 'names'
+extern void csEmitNamedGraph(FILE *out, CSFormat format, const char *title,
+                             const std::vector<std::string> &names,
+                             const CSEdgeList &edges,
+                             const char *truncated=NULL);
+
+// Write 'diff' between 'old_db' and 'new_db' as dot graph 'title': added
+// functions and calls in green, removed ones in red (calls dashed)
+extern void csEmitDiff(FILE *out, const char *title, const CSDB *old_db,
+                       const CSDB *new_db, const CSDiff &diff,
+                       const char *truncated=NULL);
+
+#endif // _EMIT_HH
@@ -0,0 +1,169 @@
+//******************************************************************************
+// Copyright (c) 2016, enferex <mattdavis9@gmail.com>
+//
+// ISC License:
+// https://www.isc.org/downloads/software-support-policy/isc-license/
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+// REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+// AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+// OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+//******************************************************************************
+
+#ifndef _FNPLOT_HH
+#define _FNPLOT_HH
+#include <atomic>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "db.hh"
+#include "emit.hh"
+
+// libfnplot: load cscope databases into a call graph and query it in
+// process.  The loaders throw a const char * describing what went wrong.
+// A loaded CSDB is read-only, so any number of threads may query it.
+//
+// The find routines return function ids, which index the graph directly
+// (see CSDB::getName, getCallees, ...), and edges as (caller, callee) id
+// pairs; nothing is formatted.  The print routines write the same results
+// as the fnplot command does.
+
+// Per query budgets.  A query that runs into one stops early, returning
+// what it found so far and which limit it hit; output is marked as
+// truncated.  Zero means no limit.
+//
+// 'top' instead prunes as it goes: only the 'top' highest ranked callees (or
+// callers) of each function are followed, those that call (or are called
+// by) the most functions themselves.  With 'top' or 'max_nodes' set,
+// neighbours are followed in that rank order.
+struct CSLimits
+{
+    size_t                   max_edges;
+    size_t                   max_nodes;  // Functions in the result
+    long                     timeout_ms; // From when the query starts
+    const std::atomic<bool> *cancel;     // Stop once this is set
+    size_t                   top;
+
+    CSLimits() :
+        max_edges(0), max_nodes(0), timeout_ms(0), cancel(NULL), top(0) {}
+};
+
+enum CSLimit
+{
+    CS_LIMIT_NONE, // Complete
+    CS_LIMIT_EDGES,
+    CS_LIMIT_NODES,
+    CS_LIMIT_TIMEOUT,
+    CS_LIMIT_CANCEL
+};
+
+// What a truncation marker says about 'limit' ("edge limit", ...), or NULL
+// for CS_LIMIT_NONE
+extern const char *csLimitName(CSLimit limit);
+
+// Loading.  Nothing is written to stderr while a graph is built unless a
+// progress hook is set: it is called with no definitions when building
+// starts, about every thousand definitions after that, and with 'done' at
+// the end.  NULL (the default) reports nothing.
+typedef void (*CSProgressFn)(size_t n_defs, bool done);
+extern void csSetProgress(CSProgressFn fn);
+extern CSDB *csLoadDatabase(const char *fname, int n_threads,
+                            bool use_snapshot, const CSDB *prev=NULL,
+                            size_t stream_budget=0);
+extern CSDB *csLoadDatabases(const std::vector<const char *> &fnames,
+                             int n_threads, bool use_snapshot,
+                             size_t stream_budget=0);
+extern CSDB *csLoadNeighbourhood(const char *fname, const char *fn_name,
+                                 int depth, bool callers, bool callees);
+
+// Load two versions of a program to compare, each merged from its databases
+// as by csLoadDatabases, side by side
+extern void csLoadVersions(const std::vector<const char *> &old_fnames,
+                           const std::vector<const char *> &new_fnames,
+                           int n_threads, bool use_snapshot,
+                           CSDB **old_db, CSDB **new_db,
+                           size_t stream_budget=0);
+
+// 'fn_name' may also be a pattern, "prefix*" or "/regex/", in which case every
+// function it matches is a root of the one traversal.  Regular expressions are
+// matched on 'n_threads' threads.
+extern bool csIsPattern(const char *fn_name);
+extern std::vector<CSFnId> csFindFunctions(const CSDB *db, const char *fn_name,
+                                           int n_threads=1);
+
+// Queries.  'depth' 0 is unbounded.  These return the limit that cut them
+// short, if any ('limits' NULL: none).
+extern CSLimit csFindCallers(const CSDB *db, const std::vector<CSFnId> &roots,
+                             int depth, CSEdgeList &edges,
+                             const CSLimits *limits=NULL);
+extern CSLimit csFindCallees(const CSDB *db, const std::vector<CSFnId> &roots,
+                             int depth, CSEdgeList &edges,
+                             const CSLimits *limits=NULL);
+extern CSLimit csFindReach(const CSDB *db, const std::vector<CSFnId> &roots,
+                           bool callers, std::vector<CSFnId> &fns,
+                           const CSLimits *limits=NULL);
+extern bool csFindPaths(const CSDB *db, CSFnId from, CSFnId to,
+                        CSEdgeList &edges);
+
+// Summarizing graphs: each function is replaced by the file (or directory)
+// that defines it.  Functions without a definition, such as library calls,
+// stay as they are.
+enum CSCollapse
+{
+    CS_COLLAPSE_NONE,
+    CS_COLLAPSE_FILE,
+    CS_COLLAPSE_DIR
+};
+
+// Collapse 'edges' as 'how' says, returning the groups' names in 'names' and
+// the distinct edges between different groups, as indexes into 'names', in
+// 'grouped'
+extern void csCollapseEdges(const CSDB *db, const CSEdgeList &edges,
+                            CSCollapse how, std::vector<std::string> &names,
+                            CSEdgeList &grouped);
+
+// Everything that changed from 'old_db' to 'new_db', in time linear in the
+// size of the graphs.  Calls are listed by caller, in the order each graph
+// has them, and functions in id order.
+extern void csFindDiff(const CSDB *old_db, const CSDB *new_db, CSDiff &diff,
+                       int n_threads=1);
+
+// Output.  With 'counts', edges say how many calls they stand for (not for
+// collapsed graphs).
+extern CSLimit csPrintCallers(FILE *out, const CSDB *db, const char *fn_name,
+                              int depth, int n_threads=1,
+                              CSFormat format=CS_FORMAT_DOT,
+                              const CSLimits *limits=NULL,
+                              CSCollapse collapse=CS_COLLAPSE_NONE,
+                              bool counts=false);
+extern CSLimit csPrintCallees(FILE *out, const CSDB *db, const char *fn_name,
+                              int depth, int n_threads=1,
+                              CSFormat format=CS_FORMAT_DOT,
+                              const CSLimits *limits=NULL,
+                              CSCollapse collapse=CS_COLLAPSE_NONE,
+                              bool counts=false);
+extern CSLimit csPrintReach(FILE *out, const CSDB *db, const char *fn_name,
+                            bool callers, int n_threads=1,
+                            const CSLimits *limits=NULL);
+extern bool csPrintPaths(FILE *out, const CSDB *db, const char *from_name,
+                         const char *to_name, bool text,
+                         CSFormat format=CS_FORMAT_DOT);
+extern CSLimit csPrintDiff(FILE *out, const CSDB *old_db, const CSDB *new_db,
+                           const char *fn_name, int depth, bool callers,
+                           int n_threads=1, const CSLimits *limits=NULL);
+extern bool csPrintBatch(FILE *out, const char *out_dir, const CSDB *db,
+                         const std::vector<std::string> &fn_names, int depth,
+                         bool callers, bool callees, int n_threads,
+                         CSFormat format=CS_FORMAT_DOT,
+                         const CSLimits *limits=NULL,
+                         CSCollapse collapse=CS_COLLAPSE_NONE,
+                         bool counts=false);
+
+#endif // _FNPLOT_HH
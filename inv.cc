@@ -0,0 +1,167 @@
+//******************************************************************************
+// Copyright (c) 2016, enferex <mattdavis9@gmail.com>
+//
+// ISC License:
+// https://www.isc.org/downloads/software-support-policy/isc-license/
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+// REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+// AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+// OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+//******************************************************************************
+
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "inv.hh"
+
+static const char *mapFile(const string &fname, size_t *size)
+{
+    int fd;
+    void *map;
+    struct stat st;
+
+    if ((fd = open(fname.c_str(), O_RDONLY)) == -1)
+      return NULL;
+    if (fstat(fd, &st) == -1 || st.st_size == 0) {
+        close(fd);
+        return NULL;
+    }
+
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+      return NULL;
+
+    *size = st.st_size;
+    return (const char *)map;
+}
+
+// cscope names the index files after the database: cscope.out has
+// cscope.in.out and cscope.po.out.
+static string indexName(const char *dbname, const char *kind)
+{
+    string name(dbname);
+    size_t slash = name.rfind('/'), dot = name.rfind('.');
+
+    if (dot == string::npos || (slash != string::npos && dot < slash))
+      return name + "." + kind;
+    return name.substr(0, dot) + "." + kind + name.substr(dot);
+}
+
+CSInvIndex::~CSInvIndex()
+{
+    if (_inv)
+      munmap((void *)_inv, _inv_size);
+    if (_post)
+      munmap((void *)_post, _post_size);
+}
+
+CSInvIndex *CSInvIndex::open(const char *dbname)
+{
+    auto inv = new CSInvIndex;
+    const CSInvParam *p;
+
+    inv->_inv = mapFile(indexName(dbname, "in"), &inv->_inv_size);
+    inv->_post = mapFile(indexName(dbname, "po"), &inv->_post_size);
+    if (!inv->_inv || !inv->_post || inv->_inv_size < sizeof(CSInvParam)) {
+        delete inv;
+        return NULL;
+    }
+
+    // The superfinger (first term of each logical block) must be in the
+    // file, and start with its block count.
+    p = inv->getParam();
+    if (p->sizeblk < (long)(3 * sizeof(long)) || p->sizeblk > (1 << 20) ||
+        p->startbyte < 0 || p->supsize < (long)sizeof(long) ||
+        p->cntlsize < 0 ||
+        (size_t)p->startbyte + p->supsize > inv->_inv_size) {
+        delete inv;
+        return NULL;
+    }
+
+    return inv;
+}
+
+bool CSInvIndex::find(
+    const char                *term,
+    std::vector<CSInvPosting> &postings) const
+{
+    const CSInvParam *p = getParam();
+    const char *iindex = _inv + p->startbyte, *blk;
+    const long *fingers = (const long *)iindex;
+    long n_blocks = fingers[0], lo, hi, mid, n_terms, post_off;
+    size_t term_len = strlen(term);
+    int cmp;
+
+    if (n_blocks <= 0 || (size_t)n_blocks >= p->supsize / sizeof(long))
+      return false;
+
+    // Find the last logical block whose first term is <= 'term'
+    for (lo = 0, hi = n_blocks - 1; lo <= hi; ) {
+        mid = (lo + hi) / 2;
+        if (fingers[mid+1] < 0 || fingers[mid+1] >= p->supsize)
+          return false;
+        cmp = strcmp(term, iindex + fingers[mid+1]);
+        if (cmp < 0)
+          hi = mid - 1;
+        else if (cmp > 0)
+          lo = mid + 1;
+        else {
+            lo = mid + 1;
+            break;
+        }
+    }
+    mid = lo ? lo - 1 : 0;
+
+    // Logical block: <n terms> <next> <prev> <entries...> ... <terms>
+    if ((size_t)(mid + 1) * p->sizeblk + p->cntlsize > _inv_size)
+      return false;
+    blk = _inv + mid * p->sizeblk + p->cntlsize;
+    n_terms = ((const long *)blk)[0];
+    auto entries = (const CSInvEntry *)((const long *)blk + 3);
+    if (n_terms < 0 ||
+        3 * sizeof(long) + n_terms * sizeof(CSInvEntry) > (size_t)p->sizeblk)
+      return false;
+
+    for (lo = 0, hi = n_terms - 1; lo <= hi; ) {
+        const CSInvEntry *e = &entries[(lo + hi) / 2];
+        if (e->offset < 0 ||
+            (long)(e->offset + e->size + sizeof(long)) > p->sizeblk)
+          return false;
+
+        cmp = strncmp(term, blk + e->offset, e->size);
+        if (cmp == 0)
+          cmp = (term_len > e->size) - (term_len < e->size);
+        if (cmp < 0)
+          hi = (lo + hi) / 2 - 1;
+        else if (cmp > 0)
+          lo = (lo + hi) / 2 + 1;
+        else {
+            // The term is followed by the offset of its postings, aligned
+            // to a long.
+            const long *ptr = (const long *)(blk + e->offset) +
+                              (e->size + sizeof(long) - 1) / sizeof(long);
+            post_off = *ptr;
+            if (post_off < 0 || e->post < 0 ||
+                (size_t)post_off + e->post * sizeof(CSInvPosting) > _post_size)
+              return false;
+
+            auto first = (const CSInvPosting *)(_post + post_off);
+            postings.insert(postings.end(), first, first + e->post);
+            return true;
+        }
+    }
+
+    // Not a symbol of the database
+    return true;
+}
@@ -0,0 +1,84 @@
+//******************************************************************************
+// Copyright (c) 2016, enferex <mattdavis9@gmail.com>
+//
+// ISC License:
+// https://www.isc.org/downloads/software-support-policy/isc-license/
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+// REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+// AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+// OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+//******************************************************************************
+
+#ifndef _INV_HH
+#define _INV_HH
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using std::string;
+
+// cscope -q inverted index (cscope.in.out + cscope.po.out).  These mirror
+// cscope's invlib.h; cscope writes them in the native layout of the
+// machine that built the index.
+struct CSInvParam
+{
+    long version;   // Inverted file version
+    long filestat;  // File status
+    long sizeblk;   // Size of logical block in bytes
+    long startbyte; // First byte of superfinger
+    long supsize;   // Size of superfinger in bytes
+    long cntlsize;  // Size of max cntl space
+    long share;     // Flag whether to use shared memory
+};
+
+struct CSInvEntry
+{
+    short         offset; // Offset of term in logical block
+    unsigned char size;   // Term size
+    unsigned char space;  // Number of longs of growth space
+    long          post;   // Number of postings
+};
+
+struct CSInvPosting
+{
+    long lineoffset;     // Source line database offset
+    long fcnoffset;      // Function name database offset
+    long fileindex : 24; // Source file name index
+    long type : 8;       // Reference type (mark character)
+};
+
+class CSInvIndex
+{
+public:
+    ~CSInvIndex();
+    CSInvIndex(const CSInvIndex &) = delete;
+    CSInvIndex &operator=(const CSInvIndex &) = delete;
+
+    // Open the index files that cscope -q writes next to 'dbname'.
+    // Returns NULL if they are missing or do not look like an index.
+    static CSInvIndex *open(const char *dbname);
+
+    // Append the postings of 'term' to 'postings'.  Returns false if the
+    // index turns out to be inconsistent.
+    bool find(const char *term, std::vector<CSInvPosting> &postings) const;
+
+private:
+    const char *_inv;
+    size_t      _inv_size;
+    const char *_post;
+    size_t      _post_size;
+
+    CSInvIndex() : _inv(nullptr), _inv_size(0), _post(nullptr), _post_size(0) {}
+    const CSInvParam *getParam() const { return (const CSInvParam *)_inv; }
+};
+
+#endif // _INV_HH
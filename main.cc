@@ -19,23 +19,135 @@
 
 #define __USE_POSIX
 #define _POSIX_C_SOURCE 200809L
+#include <algorithm>
 #include <cstdio>
 #include <cstdlib>
 #include <cerrno>
 #include <cstring>
+#include <getopt.h>
 #include <unistd.h>
 #include "cs.hh"
+#include "server.hh"
+#include "stats.hh"
+
+// Long options without a short form
+#define OPT_STATS     256
+#define OPT_MAX_EDGES 257
+#define OPT_MAX_NODES 258
+#define OPT_TIMEOUT   259
+#define OPT_TOP       260
+#define OPT_COLLAPSE  261
+#define OPT_COUNTS    262
+
+static const struct option long_opts[] = {
+    {"stats",     no_argument,       NULL, OPT_STATS},
+    {"max-edges", required_argument, NULL, OPT_MAX_EDGES},
+    {"max-nodes", required_argument, NULL, OPT_MAX_NODES},
+    {"timeout",   required_argument, NULL, OPT_TIMEOUT},
+    {"top",       required_argument, NULL, OPT_TOP},
+    {"collapse",  required_argument, NULL, OPT_COLLAPSE},
+    {"counts",    no_argument,       NULL, OPT_COUNTS},
+    {NULL, 0, NULL, 0}
+};
+
+// Read the function names, one per line, for a batch run
+static bool readNames(const char *fname, std::vector<std::string> &names)
+{
+    char *line = NULL;
+    size_t line_len = 0;
+    ssize_t len;
+    FILE *fp = strcmp(fname, "-") ? fopen(fname, "r") : stdin;
+
+    if (!fp)
+      return false;
+
+    while ((len = getline(&line, &line_len, fp)) != -1) {
+        char *name = line + strspn(line, " \t");
+        name[strcspn(name, " \t\r\n")] = '\0';
+        if (name[0])
+          names.emplace_back(name);
+    }
+
+    free(line);
+    if (fp != stdin)
+      fclose(fp);
+    return true;
+}
+
+// Spin on stderr while the graph is built, stdout may well be the graph
+static void showProgress(size_t n_defs, bool done)
+{
+    static const char spin[] = "-\\|/";
+    static int sidx;
+
+    if (done)
+      fputs("\b Done \n", stderr);
+    else if (n_defs)
+      fprintf(stderr, "\b%c", spin[sidx++ % 4]);
+    else
+      fputs("Building internal database: ", stderr);
+}
+
+// Finish a "Building ..." progress message
+static void reportDone(CSLimit stop)
+{
+    if (stop)
+      fprintf(stderr, "Truncated (%s)\n", csLimitName(stop));
+    else
+      fprintf(stderr, "Done\n");
+}
 
 static void usage(const char *execname)
 {
-    printf("Usage: %s -c cscope.out -f fn_name "
-           "[-o outputfile] [-d depth] <-x | -y>\n"
-           "  -c cscope.out: cscope.out database file\n"
-           "  -f fn_name:    Function name to plot callers of\n"
-           "  -d depth:      Depth of traversal.\n"
+    printf("Usage: %s -c cscope.out <-f fn_name | -b namefile | -S socket> "
+           "[-o outputfile | -O outputdir] [-d depth] [-j threads] [-s] "
+           "[-F format] "
+           "<-x | -y | -t fn_name [-T]> [-r] [-D cscope.out]\n"
+           "  -c cscope.out: cscope.out database file ('-' for stdin).\n"
+           "                 Repeat to merge several databases into one\n"
+           "                 graph.\n"
+           "  -f fn_name:    Function name to plot callers of, or a pattern:\n"
+           "                 'prefix*' or '/regex/' plots all that match.\n"
+           "  -b namefile:   Plot each function named in namefile, one per\n"
+           "                 line ('-' for stdin).\n"
+           "  -t fn_name:    Print the shortest call paths from -f fn_name\n"
+           "                 to this function.\n"
+           "  -T:            With -t, list the paths as text instead of dot.\n"
+           "  -D cscope.out: Plot the calls that changed since this older\n"
+           "                 database (repeatable, as for -c): all of them,\n"
+           "                 or those among the callers (callees) of -f.\n"
+           "  -d depth:      Depth of traversal (0 or 'inf': unbounded).\n"
+           "  -r:            List every function that fn_name reaches (-y)\n"
+           "                 or is reached from (-x), at any depth.\n"
+           "  -S socket:     Serve queries on the Unix domain socket, "
+                             "reloading\n"
+           "                 cscope.out when it changes.\n"
+           "  -j threads:    Parse the database, match -f patterns, and run\n"
+           "                 -b queries with this many threads.\n"
+           "  -m megabytes:  Stream the database, reading at most about this\n"
+           "                 much of it at a time.\n"
            "  -o outputfile: Write results to outputfile.\n"
+           "  -O outputdir:  With -b, write each function's results to\n"
+           "                 outputdir/fn_name.dot (.json, .bin).\n"
+           "  -F format:     Write graphs as 'dot' (default), 'json' (an\n"
+           "                 object per line) or 'binary' (varint records).\n"
+           "  -s:            Cache the call graph in cscope.out"
+                             CS_SNAPSHOT_EXT ".\n"
            "  -x:            Print callers of fn_name.\n"
            "  -y:            Print calless of fn_name.\n"
+           "  --max-edges n: Stop a callers, callees or -r query once it\n"
+           "                 has found n edges,\n"
+           "  --max-nodes n: or n functions,\n"
+           "  --timeout ms:  or after ms milliseconds, marking its results\n"
+           "                 as truncated.\n"
+           "  --top k:       Follow only the k callers (or callees) of each\n"
+           "                 function that lead to the most others.\n"
+           "  --collapse by: Plot the files ('file') or directories ('dir')\n"
+           "                 defining the functions instead.\n"
+           "  --counts:      Label each call with how many times the\n"
+           "                 caller makes it.\n"
+           "  --stats:       Report timings, sizes and memory use as JSON\n"
+           "                 on stderr.\n"
            "  -h:            This help message.\n",
            execname);
     exit(EXIT_SUCCESS);
@@ -45,37 +157,107 @@ int main(int argc, char **argv)
 {
     int opt;
     FILE *out;
-    bool do_callees, do_callers;
-    const char *fname, *fn_name, *out_fname;
-    CS *cs;
-    CSDB *db;
-    int depth = 2;
+    bool do_callees, do_callers, use_snapshot, stats, text, reach, counts;
+    const char *fname, *fn_name, *out_fname, *names_fname, *out_dname;
+    const char *sock_path, *to_name;
+    std::vector<std::string> fn_names;
+    std::vector<const char *> fnames, old_fnames;
+    CSDB *db, *old_db;
+    int depth = 2, n_threads = 1;
+    long budget_mb = 0;
+    CSFormat format = CS_FORMAT_DOT;
+    CSLimits limits;
+    CSLimit stop;
+    long max_edges = 0, max_nodes = 0, top = 0;
+    CSCollapse collapse = CS_COLLAPSE_NONE;
+    bool bad_arg = false;
 
-    do_callers = do_callees = false;
-    fname = out_fname = fn_name = NULL;
+    do_callers = do_callees = use_snapshot = stats = text = reach = false;
+    counts = false;
+    fname = out_fname = fn_name = names_fname = out_dname = sock_path = NULL;
+    to_name = NULL;
 
-    while ((opt = getopt(argc, argv, "c:d:f:o:hxy")) != -1) {
+    while ((opt = getopt_long(argc, argv, "b:c:D:d:f:F:j:m:o:O:S:t:hrsTxy",
+                              long_opts, NULL)) != -1) {
         switch (opt) {
-        case 'c': fname = optarg; break;
-        case 'd': depth = atoi(optarg); break;
+        case 'b': names_fname = optarg; break;
+        case 'c': fnames.push_back(optarg); break;
+        case 'D': old_fnames.push_back(optarg); break;
+        case 'd': depth = strcmp(optarg, "inf") ? atoi(optarg) : 0; break;
         case 'f': fn_name = optarg; break;
+        case 'F': bad_arg = !csParseFormat(optarg, &format); break;
+        case 'j': n_threads = atoi(optarg); break;
+        case 'm': budget_mb = atol(optarg); break;
         case 'o': out_fname = optarg; break;
+        case 'O': out_dname = optarg; break;
+        case 'r': reach = true; break;
+        case 'S': sock_path = optarg; break;
+        case 's': use_snapshot = true; break;
+        case 't': to_name = optarg; break;
+        case 'T': text = true; break;
         case 'x': do_callers = true; break;
         case 'y': do_callees = true; break;
         case 'h': usage(argv[0]); break;
+        case OPT_STATS: stats = true; break;
+        case OPT_COUNTS: counts = true; break;
+        case OPT_MAX_EDGES: max_edges = atol(optarg); break;
+        case OPT_MAX_NODES: max_nodes = atol(optarg); break;
+        case OPT_TIMEOUT: limits.timeout_ms = atol(optarg); break;
+        case OPT_TOP: top = atol(optarg); break;
+        case OPT_COLLAPSE:
+            if (!strcmp(optarg, "file"))
+              collapse = CS_COLLAPSE_FILE;
+            else if (!strcmp(optarg, "dir"))
+              collapse = CS_COLLAPSE_DIR;
+            else
+              bad_arg = true;
+            break;
         default: return EXIT_FAILURE;
         }
     }
 
-    if (!fname || !fn_name || depth < 0) {
+    auto is_stdin = [](const char *f) { return !strcmp(f, "-"); };
+    const bool diff = !old_fnames.empty();
+    const long n_stdin =
+        std::count_if(fnames.begin(), fnames.end(), is_stdin) +
+        std::count_if(old_fnames.begin(), old_fnames.end(), is_stdin);
+    if (fnames.empty() || (sock_path && fnames.size() > 1) ||
+        ((sock_path || use_snapshot) && n_stdin) || n_stdin > 1 ||
+        budget_mb < 0 || bad_arg ||
+        max_edges < 0 || max_nodes < 0 || limits.timeout_ms < 0 || top < 0 ||
+        (to_name && (max_edges || max_nodes || limits.timeout_ms || top)) ||
+        (reach && top) ||
+        (collapse && (to_name || reach || sock_path)) ||
+        (counts && (to_name || reach || sock_path || diff || collapse ||
+                    format == CS_FORMAT_BINARY)) ||
+        (format != CS_FORMAT_DOT && (sock_path || reach || text)) ||
+        (diff && (names_fname || sock_path || to_name || reach || top ||
+                  collapse || format != CS_FORMAT_DOT ||
+                  (!fn_name && (max_edges || max_nodes ||
+                                limits.timeout_ms)))) ||
+        (!diff && (!!fn_name + !!names_fname + !!sock_path) != 1) ||
+        (out_dname && !names_fname) || (to_name && !fn_name) ||
+        (reach && (!fn_name || to_name || (do_callers && do_callees))) ||
+        (out_fname && out_dname) || depth < 0 || n_threads < 1) {
         fprintf(stderr, "Invalid options, see '-h'\n");
         return EXIT_FAILURE;
     }
 
+    fname = fnames[0];
+    limits.max_edges = max_edges;
+    limits.max_nodes = max_nodes;
+    limits.top = top;
+
     // If the user did not specify callers or callees, do so for them!
     if (!do_callers && !do_callees)
       do_callees = true;
 
+    if (names_fname && !readNames(names_fname, fn_names)) {
+        fprintf(stderr, "Error reading function names from %s: %s\n",
+                names_fname, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
     if (out_fname && !(out = fopen(out_fname, "w"))) {
         fprintf(stderr, "Error opening output file %s: %s\n",
                 out_fname, strerror(errno));
@@ -85,21 +267,91 @@ int main(int argc, char **argv)
       out = stdout;
 
     // Load
+    csSetProgress(showProgress);
+    // Without a snapshot, a cscope -q index lets us parse just the part of
+    // the database the query needs.  Not for a query that follows ranks
+    // (--top, --max-nodes), they need the whole graph.
     try {
-        cs = new CS(fname);
+        db = old_db = NULL;
+        if (diff)
+          csLoadVersions(old_fnames, fnames, n_threads, use_snapshot, &old_db,
+                         &db, (size_t)budget_mb << 20);
+        else if (fnames.size() == 1 && fn_name && !to_name && !use_snapshot &&
+            !budget_mb && !is_stdin(fname) && !csIsPattern(fn_name) &&
+            !top && !max_nodes)
+          db = csLoadNeighbourhood(fname, fn_name, reach ? 0 : depth,
+                                   do_callers, do_callees);
+        if (!db)
+          db = csLoadDatabases(fnames, n_threads, use_snapshot,
+                               (size_t)budget_mb << 20);
     } 
     catch (const char *err) {
         fprintf(stderr, "Error loading cscope database: %s\n", err);
         exit(EXIT_FAILURE);
     }
-    db = cs->buildDatabase();
+
+    if (sock_path)
+      return csServe(sock_path, fname, db, n_threads, use_snapshot,
+                     (size_t)budget_mb << 20, limits) ?
+             EXIT_SUCCESS : EXIT_FAILURE;
 
     // Go!
-    if (do_callers)
-      csPrintCallers(out, db, fn_name, depth);
-    if (do_callees)
-      csPrintCallees(out, db, fn_name, depth);
+    // The graph is read-only from here on, so batch queries share it.
+    if (names_fname) {
+        if (!csPrintBatch(out, out_dname, db, fn_names, depth,
+                          do_callers, do_callees, n_threads, format,
+                          &limits, collapse, counts)) {
+            fprintf(stderr, "Error writing results\n");
+            return EXIT_FAILURE;
+        }
+    }
+    else if (diff) {
+        if (!fn_name) {
+            fprintf(stderr, "Comparing call graphs... ");
+            reportDone(csPrintDiff(out, old_db, db, NULL, 0, false,
+                                   n_threads));
+        }
+        if (fn_name && do_callers) {
+            fprintf(stderr, "Comparing callers... ");
+            reportDone(csPrintDiff(out, old_db, db, fn_name, depth, true,
+                                   n_threads, &limits));
+        }
+        if (fn_name && do_callees) {
+            fprintf(stderr, "Comparing callees... ");
+            reportDone(csPrintDiff(out, old_db, db, fn_name, depth, false,
+                                   n_threads, &limits));
+        }
+    }
+    else if (to_name) {
+        if (!csPrintPaths(out, db, fn_name, to_name, text, format))
+          fprintf(stderr, "No call path from %s to %s\n", fn_name, to_name);
+    }
+    else if (reach) {
+        if ((stop = csPrintReach(out, db, fn_name, do_callers, n_threads,
+                                 &limits)))
+          reportDone(stop);
+    }
+    else {
+        if (do_callers) {
+            fprintf(stderr, "Building callers... ");
+            stop = csPrintCallers(out, db, fn_name, depth, n_threads, format,
+                                  &limits, collapse, counts);
+            reportDone(stop);
+        }
+        if (do_callees) {
+            fprintf(stderr, "Building callees... ");
+            stop = csPrintCallees(out, db, fn_name, depth, n_threads, format,
+                                  &limits, collapse, counts);
+            reportDone(stop);
+        }
+    }
+
+    {
+        CSPhaseTimer timer(CS_PHASE_OUTPUT);
+        fclose(out);
+    }
 
-    fclose(out);
+    if (stats)
+      csStatsPrint(stderr, db);
     return 0;
 }
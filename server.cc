@@ -0,0 +1,249 @@
+//******************************************************************************
+// Copyright (c) 2016, enferex <mattdavis9@gmail.com>
+//
+// ISC License:
+// https://www.isc.org/downloads/software-support-policy/isc-license/
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+// REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+// AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+// OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+//******************************************************************************
+
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "cs.hh"
+#include "server.hh"
+
+#define ERR(...) do {fprintf(stderr,__VA_ARGS__);fputc('\n', stderr);} while(0)
+
+typedef std::shared_ptr<const CSDB> CSDBRef;
+
+// The graph that new queries run against.  Only ever accessed with
+// std::atomic_load/store; a query keeps its own reference for as long as it
+// runs, so a reload never pulls a graph out from under it.
+static CSDBRef current;
+
+// Budgets for every query
+static CSLimits limits;
+
+// Clients being served
+static std::atomic<int> n_clients;
+
+static bool sendAll(int fd, const char *buf, size_t len)
+{
+    while (len) {
+        ssize_t n = send(fd, buf, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+          continue;
+        if (n < 0)
+          return false;
+        buf += n;
+        len -= n;
+    }
+    return true;
+}
+
+// A depth is a non-negative integer, or "inf" (0: unbounded).  Returns -1 for
+// anything else.
+static int parseDepth(const char *str)
+{
+    char *end;
+    long depth;
+
+    if (!strcmp(str, "inf"))
+      return 0;
+    if (*str < '0' || *str > '9')
+      return -1;
+    errno = 0;
+    depth = strtol(str, &end, 10);
+    if (*end || errno || depth > INT_MAX)
+      return -1;
+    return (int)depth;
+}
+
+static bool sendError(int fd, const char *msg)
+{
+    char buf[128];
+    int len = snprintf(buf, sizeof(buf), "error %s\n", msg);
+    return sendAll(fd, buf, len);
+}
+
+// Answer one request 'line'.  Returns false once the client should be
+// dropped.
+static bool answer(int fd, char *line)
+{
+    char *save, *cmd, *depth_str, *fn_name, *buf;
+    const char *delims = " \t\r\n";
+    size_t len;
+    int depth;
+    bool callers;
+    FILE *fp;
+
+    if (!(cmd = strtok_r(line, delims, &save)))
+      return true;
+    if (!strcmp(cmd, "quit"))
+      return false;
+
+    depth_str = strtok_r(NULL, delims, &save);
+    fn_name = strtok_r(NULL, delims, &save);
+    if (!depth_str || !fn_name || strtok_r(NULL, delims, &save))
+      return sendError(fd, "expected <callers|callees> <depth> <fn_name>");
+    if ((callers = !strcmp(cmd, "callers")) == false && strcmp(cmd, "callees"))
+      return sendError(fd, "unknown request");
+    if ((depth = parseDepth(depth_str)) < 0)
+      return sendError(fd, "invalid depth");
+
+    CSDBRef db = std::atomic_load(&current);
+    buf = NULL;
+    len = 0;
+    if (!(fp = open_memstream(&buf, &len)))
+      return sendError(fd, "out of memory");
+    if (callers)
+      csPrintCallers(fp, db.get(), fn_name, depth, 1, CS_FORMAT_DOT, &limits);
+    else
+      csPrintCallees(fp, db.get(), fn_name, depth, 1, CS_FORMAT_DOT, &limits);
+    fclose(fp);
+
+    char hdr[32];
+    int hdr_len = snprintf(hdr, sizeof(hdr), "ok %zu\n", len);
+    bool ok = sendAll(fd, hdr, hdr_len) && sendAll(fd, buf, len);
+    free(buf);
+    return ok;
+}
+
+static void serveClient(int fd)
+{
+    char *line = NULL;
+    size_t line_len = 0;
+    FILE *in;
+
+    if (!(in = fdopen(fd, "r"))) {
+        close(fd);
+        --n_clients;
+        return;
+    }
+
+    while (getline(&line, &line_len, in) != -1 && answer(fd, line))
+      ;
+
+    free(line);
+    fclose(in);
+    --n_clients;
+}
+
+// Reload 'fname' whenever it no longer matches the graph being served.  A
+// database that fails to load is left alone until it changes again.
+static void watch(
+    const char *fname,
+    int         n_threads,
+    bool        use_snapshot,
+    size_t      stream_budget)
+{
+    struct stat st;
+    struct timespec failed_mtime = {0, 0};
+    off_t failed_size = -1;
+
+    for (;;) {
+        sleep(CS_SERVE_POLL_SECS);
+
+        CSDBRef db = std::atomic_load(&current);
+        const CSDBSource &src = db->getSource();
+        if (stat(fname, &st) == -1 ||
+            ((uint64_t)st.st_size == src.size &&
+             st.st_mtim.tv_sec == src.mtime &&
+             st.st_mtim.tv_nsec == src.mtime_nsec))
+          continue;
+        if (st.st_size == failed_size &&
+            st.st_mtim.tv_sec == failed_mtime.tv_sec &&
+            st.st_mtim.tv_nsec == failed_mtime.tv_nsec)
+          continue;
+
+        try {
+            CSDBRef next(csLoadDatabase(fname, n_threads, use_snapshot,
+                                        db.get(), stream_budget));
+            std::atomic_store(&current, next);
+        }
+        catch (const char *err) {
+            ERR("Error reloading cscope database %s: %s", fname, err);
+            failed_size = st.st_size;
+            failed_mtime = st.st_mtim;
+        }
+    }
+}
+
+bool csServe(
+    const char     *sock_path,
+    const char     *fname,
+    CSDB           *db,
+    int             n_threads,
+    bool            use_snapshot,
+    size_t          stream_budget,
+    const CSLimits &query_limits)
+{
+    int lfd, fd;
+    struct stat st;
+    struct sockaddr_un addr;
+
+    std::atomic_store(&current, CSDBRef(db));
+    limits = query_limits;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(sock_path) >= sizeof(addr.sun_path)) {
+        ERR("Socket path is too long: %s", sock_path);
+        return false;
+    }
+    strcpy(addr.sun_path, sock_path);
+
+    // Clear out a socket left behind by a previous server
+    if (stat(sock_path, &st) == 0 && S_ISSOCK(st.st_mode))
+      unlink(sock_path);
+
+    if ((lfd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) == -1 ||
+        bind(lfd, (struct sockaddr *)&addr, sizeof(addr)) == -1 ||
+        listen(lfd, SOMAXCONN) == -1) {
+        ERR("Error listening on %s: %s", sock_path, strerror(errno));
+        if (lfd != -1)
+          close(lfd);
+        return false;
+    }
+
+    std::thread(watch, fname, n_threads, use_snapshot, stream_budget).detach();
+
+    for (;;) {
+        if ((fd = accept4(lfd, NULL, NULL, SOCK_CLOEXEC)) != -1) {
+            if (n_clients >= CS_SERVE_MAX_CLIENTS) {
+                sendError(fd, "too many clients");
+                close(fd);
+                continue;
+            }
+            ++n_clients;
+            std::thread(serveClient, fd).detach();
+        }
+        else if (errno != EINTR && errno != ECONNABORTED) {
+            ERR("Error accepting on %s: %s", sock_path, strerror(errno));
+            break;
+        }
+    }
+
+    close(lfd);
+    return false;
+}
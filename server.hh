@@ -0,0 +1,48 @@
+//******************************************************************************
+// Copyright (c) 2016, enferex <mattdavis9@gmail.com>
+//
+// ISC License:
+// https://www.isc.org/downloads/software-support-policy/isc-license/
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+// REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+// AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+// OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+//******************************************************************************
+
+#ifndef _SERVER_HH
+#define _SERVER_HH
+#include "db.hh"
+#include "fnplot.hh"
+
+// How often (seconds) the server checks whether the database has changed
+#define CS_SERVE_POLL_SECS 1
+
+// Most clients served at once; more are turned away with an error
+#define CS_SERVE_MAX_CLIENTS 64
+
+// Answer queries on the Unix domain socket 'sock_path' until killed, starting
+// from graph 'db' of cscope database 'fname' (the server takes ownership).
+// Whenever 'fname' changes it is reloaded, with 'n_threads', 'use_snapshot'
+// and 'stream_budget' as for csLoadDatabase, and swapped in for new
+// queries.  Every query is held to 'limits'.
+//
+// Each request is one line:
+//     callers <depth> <fn_name>
+//     callees <depth> <fn_name>
+// and is answered with "ok <n>\n" followed by <n> bytes of dot (with a
+// truncation comment if a limit cut it short), or with "error <message>\n".
+// Each client has a thread of its own, up to CS_SERVE_MAX_CLIENTS at once.
+// Returns false if the socket cannot be set up.
+extern bool csServe(const char *sock_path, const char *fname, CSDB *db,
+                    int n_threads, bool use_snapshot, size_t stream_budget,
+                    const CSLimits &limits=CSLimits());
+
+#endif // _SERVER_HH
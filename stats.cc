@@ -0,0 +1,77 @@
+//******************************************************************************
+// Copyright (c) 2016, enferex <mattdavis9@gmail.com>
+//
+// ISC License:
+// https://www.isc.org/downloads/software-support-policy/isc-license/
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+// REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+// AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+// OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+//******************************************************************************
+
+#include <sys/resource.h>
+#include "stats.hh"
+
+CSStats cs_stats;
+
+static const char *phase_names[CS_N_PHASES] = {
+    "mmap", "header", "trailer", "parse", "build", "snapshot", "traversal",
+    "output"
+};
+
+static uint64_t nsSince(const struct timespec &st, clockid_t clock)
+{
+    struct timespec now;
+    clock_gettime(clock, &now);
+    return (now.tv_sec - st.tv_sec) * 1000000000ULL + now.tv_nsec - st.tv_nsec;
+}
+
+CSPhaseTimer::~CSPhaseTimer()
+{
+    cs_stats.wall_ns[_phase] += nsSince(_wall, CLOCK_MONOTONIC);
+    cs_stats.cpu_ns[_phase] += nsSince(_cpu, CLOCK_PROCESS_CPUTIME_ID);
+    ++cs_stats.runs[_phase];
+}
+
+void csStatsPrint(FILE *fp, const CSDB *db)
+{
+    struct rusage ru;
+
+    fprintf(fp, "{\"phases\": {");
+    for (int i=0; i<CS_N_PHASES; ++i)
+      fprintf(fp, "%s\"%s\": {\"wall_ms\": %.3f, \"cpu_ms\": %.3f, "
+              "\"runs\": %llu}", i ? ", " : "", phase_names[i],
+              cs_stats.wall_ns[i] / 1e6, cs_stats.cpu_ns[i] / 1e6,
+              (unsigned long long)cs_stats.runs[i]);
+    fprintf(fp, "}, ");
+
+    fprintf(fp, "\"database_bytes\": %llu, \"bytes_scanned\": %llu, ",
+            (unsigned long long)cs_stats.database_bytes,
+            (unsigned long long)cs_stats.bytes_scanned);
+
+    if (db)
+      fprintf(fp, "\"files\": %zu, \"definitions\": %zu, \"calls\": %zu, "
+              "\"functions\": %zu, \"edges\": %zu, \"components\": %zu, ",
+              db->getFileCount(), db->getDefCount(), db->getCallCount(),
+              db->getFunctionCount(), db->getEdgeCount(), db->getSccCount());
+
+    // ru_maxrss is in kilobytes on Linux
+    getrusage(RUSAGE_SELF, &ru);
+    fprintf(fp, "\"peak_rss_kb\": %ld, \"allocations\": %llu, "
+            "\"allocated_bytes\": %llu, \"arena_chunks\": %llu, "
+            "\"arena_bytes\": %llu, \"patched_graphs\": %llu}\n",
+            ru.ru_maxrss,
+            (unsigned long long)cs_stats.allocs,
+            (unsigned long long)cs_stats.alloc_bytes,
+            (unsigned long long)cs_stats.arena_chunks,
+            (unsigned long long)cs_stats.arena_bytes,
+            (unsigned long long)cs_stats.patches);
+}
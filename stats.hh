@@ -0,0 +1,81 @@
+//******************************************************************************
+// Copyright (c) 2016, enferex <mattdavis9@gmail.com>
+//
+// ISC License:
+// https://www.isc.org/downloads/software-support-policy/isc-license/
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+// REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+// AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+// OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+//******************************************************************************
+
+#ifndef _STATS_HH
+#define _STATS_HH
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include "db.hh"
+
+// Phases timed for --stats
+enum CSPhase
+{
+    CS_PHASE_MMAP,
+    CS_PHASE_HEADER,
+    CS_PHASE_TRAILER,
+    CS_PHASE_PARSE,     // File sections (or the -q neighbourhood)
+    CS_PHASE_BUILD,     // CS::buildDatabase
+    CS_PHASE_SNAPSHOT,  // Loading or saving -s snapshots
+    CS_PHASE_TRAVERSAL,
+    CS_PHASE_OUTPUT,
+    CS_N_PHASES
+};
+
+// Process wide counters.  They are cheap enough to always keep, and are
+// only reported with --stats.  Phases running on several threads at once
+// (batch queries) add up each thread's wall time; CPU time is the whole
+// process's while the phase ran.
+struct CSStats
+{
+    std::atomic<uint64_t> wall_ns[CS_N_PHASES];
+    std::atomic<uint64_t> cpu_ns[CS_N_PHASES];
+    std::atomic<uint64_t> runs[CS_N_PHASES];
+    std::atomic<uint64_t> database_bytes;
+    std::atomic<uint64_t> bytes_scanned;
+    std::atomic<uint64_t> allocs;       // operator new (alloc.cc)
+    std::atomic<uint64_t> alloc_bytes;
+    std::atomic<uint64_t> arena_chunks;
+    std::atomic<uint64_t> arena_bytes;
+    std::atomic<uint64_t> patches;      // Graphs patched on reload (db.cc)
+};
+
+extern CSStats cs_stats;
+
+// Adds the time between construction and destruction to 'phase'
+class CSPhaseTimer
+{
+public:
+    CSPhaseTimer(CSPhase phase) : _phase(phase) {
+        clock_gettime(CLOCK_MONOTONIC, &_wall);
+        clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &_cpu);
+    }
+    ~CSPhaseTimer();
+
+private:
+    CSPhase         _phase;
+    struct timespec _wall;
+    struct timespec _cpu;
+};
+
+// Write the statistics, and the sizes of graph 'db', to 'fp' as JSON
+extern void csStatsPrint(FILE *fp, const CSDB *db);
+
+#endif // _STATS_HH
@@ -0,0 +1,296 @@
+//******************************************************************************
+// Copyright (c) 2016, enferex <mattdavis9@gmail.com>
+//
+// ISC License:
+// https://www.isc.org/downloads/software-support-policy/isc-license/
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+// REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+// AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+// OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+//******************************************************************************
+
+// Make random edits to an uncompressed cscope database from bench/csgen, so
+// that 'make test' can check that reloading it patches the graph into the
+// one a full build makes.  Each edit is of one of these kinds:
+//   static: make a definition static, or no longer static
+//   remove: remove a call, or a file
+//   add:    add a call, a definition, or a copy of a file
+//   mix:    any of the above, or point a call or a definition at another
+//           name, or rename or move a file
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+struct Section
+{
+    std::string name;
+    std::string body;
+};
+
+static std::mt19937_64 rng;
+static std::vector<std::string> names; // Functions defined
+
+static size_t pick(size_t n)
+{
+    return std::uniform_int_distribution<size_t>(0, n - 1)(rng);
+}
+
+// A function to call or define: mostly an existing one
+static std::string pickName()
+{
+    if (pick(10))
+      return names[pick(names.size())];
+    return "fn_new" + std::to_string(pick(5));
+}
+
+// Where the names marked 'mark' in 'body' start
+static std::vector<size_t> findMarks(const std::string &body, char mark)
+{
+    std::vector<size_t> at;
+    const char tag[] = {'\n', '\t', mark, '\0'};
+
+    for (size_t i=body.find(tag); i!=std::string::npos;
+         i=body.find(tag, i + 1))
+      at.push_back(i + 3);
+    return at;
+}
+
+// Replace the name at 'at' in 'body'
+static void setName(std::string &body, size_t at, const std::string &name)
+{
+    body.replace(at, body.find('\n', at) - at, name);
+}
+
+static bool flipStatic(Section &sec)
+{
+    auto defs = findMarks(sec.body, '$');
+    if (defs.empty())
+      return false;
+
+    // The definition's line, "<line> [static ]int ", is before its mark
+    size_t mark = defs[pick(defs.size())] - 3;
+    size_t start = sec.body.rfind('\n', mark - 1) + 1;
+    size_t at = sec.body.find(' ', start) + 1;
+    if (sec.body.compare(at, 7, "static ") == 0)
+      sec.body.erase(at, 7);
+    else
+      sec.body.insert(at, "static ");
+    return true;
+}
+
+static bool removeCall(Section &sec)
+{
+    auto calls = findMarks(sec.body, '`');
+    if (calls.empty())
+      return false;
+
+    size_t at = calls[pick(calls.size())];
+    sec.body.erase(at - 2, sec.body.find('\n', at) + 1 - (at - 2));
+    return true;
+}
+
+// A call is added after another, on the same line
+static bool addCall(Section &sec)
+{
+    auto calls = findMarks(sec.body, '`');
+    if (calls.empty())
+      return false;
+
+    size_t at = sec.body.find('\n', calls[pick(calls.size())]) + 1;
+    sec.body.insert(at, "\t`" + pickName() + "\n");
+    return true;
+}
+
+static void addDefinition(Section &sec)
+{
+    std::string line = std::to_string(100000 + pick(100000));
+
+    sec.body += line + " int \n\t$fn_new" + std::to_string(pick(5)) +
+                "\n(int \narg\n)\n\n" + line + " \n\t`" + pickName() +
+                "\n(\narg\n);\n\n" + line + " }\n\t}\n\n";
+}
+
+static bool retarget(Section &sec, char mark)
+{
+    auto at = findMarks(sec.body, mark);
+    if (at.empty())
+      return false;
+
+    setName(sec.body, at[pick(at.size())], pickName());
+    return true;
+}
+
+static std::string newFileName(const char *what)
+{
+    return "src/" + std::string(what) + std::to_string(pick(1000)) + ".c";
+}
+
+static void edit(std::vector<Section> &secs, const char *kind)
+{
+    size_t i = pick(secs.size());
+    Section &sec = secs[i];
+
+    if (!strcmp(kind, "mix")) {
+        static const char *kinds[] = {"static", "remove", "add"};
+        switch (pick(7)) {
+        case 0: retarget(sec, '`'); return;
+        case 1: retarget(sec, '$'); return;
+        case 2: sec.name = newFileName("ren"); return;
+        case 3: {
+            Section moved = sec;
+            secs.erase(secs.begin() + i);
+            secs.insert(secs.begin() + pick(secs.size() + 1), moved);
+            return;
+        }
+        default: edit(secs, kinds[pick(3)]); return;
+        }
+    }
+
+    if (!strcmp(kind, "static"))
+      flipStatic(sec);
+    else if (!strcmp(kind, "remove")) {
+        if (pick(4) || secs.size() <= 2)
+          removeCall(sec);
+        else
+          secs.erase(secs.begin() + i);
+    }
+    else if (!strcmp(kind, "add")) {
+        switch (pick(4)) {
+        case 0: addDefinition(sec); break;
+        case 1: {
+            Section copy = sec;
+            copy.name = newFileName("new");
+            secs.insert(secs.begin() + pick(secs.size() + 1), copy);
+            break;
+        }
+        default: addCall(sec); break;
+        }
+    }
+}
+
+static bool load(const char *fname, std::string &hdr,
+                 std::vector<Section> &secs)
+{
+    FILE *fp;
+    std::string data;
+    char buf[65536];
+    size_t n, pos, off;
+
+    if (!(fp = fopen(fname, "r")))
+      return false;
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+      data.append(buf, n);
+    fclose(fp);
+
+    // "cscope 15 <dir> -c <trailer offset>", then "\t@<file>" sections
+    if ((pos = data.find('\n')) == std::string::npos)
+      return false;
+    hdr = data.substr(0, data.rfind(' ', pos) + 1);
+    off = strtoul(data.c_str() + hdr.size(), NULL, 10);
+    for (++pos; data.compare(pos, 2, "\t@") == 0 && pos < off; ) {
+        size_t name_end = data.find('\n', pos);
+        size_t end = data.find("\n\t@", name_end);
+        if (name_end == pos + 2 || end == std::string::npos)
+          break;
+        secs.push_back({data.substr(pos + 2, name_end - pos - 2),
+                        data.substr(name_end + 1, end - name_end)});
+        pos = end + 1;
+    }
+
+    return !secs.empty();
+}
+
+static bool save(const char *fname, const std::string &hdr,
+                 const std::vector<Section> &secs)
+{
+    FILE *fp;
+    std::string body;
+    size_t names_len = 0;
+    char off[16];
+
+    for (const auto &sec: secs) {
+        body += "\t@" + sec.name + "\n" + sec.body;
+        names_len += sec.name.size() + 1;
+    }
+    body += "\t@\n";
+
+    if (!(fp = fopen(fname, "w")))
+      return false;
+    snprintf(off, sizeof(off), "%010zu\n", hdr.size() + 11 + body.size());
+    fprintf(fp, "%s%s", hdr.c_str(), off);
+    fwrite(body.data(), 1, body.size(), fp);
+    fprintf(fp, "1\n.\n0\n0\n%zu\n%zu\n", secs.size(), names_len);
+    for (const auto &sec: secs)
+      fprintf(fp, "%s\n", sec.name.c_str());
+    return fclose(fp) == 0;
+}
+
+static void usage(const char *execname)
+{
+    printf("Usage: %s [-k kind] [-n edits] [-s seed] cscope.out\n"
+           "  -k kind:  static, remove, add or mix (default mix).\n"
+           "  -n edits: Number of edits (default 1).\n"
+           "  -s seed:  Random seed (default 1).\n"
+           "  -h:       This help message.\n",
+           execname);
+    exit(EXIT_SUCCESS);
+}
+
+int main(int argc, char **argv)
+{
+    int opt;
+    long n_edits = 1, seed = 1;
+    const char *kind = "mix";
+    std::string hdr;
+    std::vector<Section> secs;
+
+    while ((opt = getopt(argc, argv, "k:n:s:h")) != -1) {
+        switch (opt) {
+        case 'k': kind = optarg; break;
+        case 'n': n_edits = atol(optarg); break;
+        case 's': seed = atol(optarg); break;
+        case 'h': usage(argv[0]); break;
+        default: return EXIT_FAILURE;
+        }
+    }
+
+    if (optind != argc - 1 || n_edits < 0 ||
+        (strcmp(kind, "static") && strcmp(kind, "remove") &&
+         strcmp(kind, "add") && strcmp(kind, "mix"))) {
+        fprintf(stderr, "Invalid options, see '-h'\n");
+        return EXIT_FAILURE;
+    }
+
+    if (!load(argv[optind], hdr, secs)) {
+        fprintf(stderr, "%s: Not a database from csgen\n", argv[optind]);
+        return EXIT_FAILURE;
+    }
+
+    for (const auto &sec: secs)
+      for (auto at: findMarks(sec.body, '$'))
+        names.push_back(sec.body.substr(at, sec.body.find('\n', at) - at));
+    if (names.empty())
+      names.push_back("fn_new0");
+
+    rng.seed(seed);
+    for (long i=0; i<n_edits; ++i)
+      edit(secs, kind);
+
+    if (!save(argv[optind], hdr, secs)) {
+        perror(argv[optind]);
+        return EXIT_FAILURE;
+    }
+    return 0;
+}
@@ -0,0 +1,217 @@
+//******************************************************************************
+// Copyright (c) 2016, enferex <mattdavis9@gmail.com>
+//
+// ISC License:
+// https://www.isc.org/downloads/software-support-policy/isc-license/
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+// REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+// AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+// OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+//******************************************************************************
+
+// Compare two fnplot snapshots section by section, as 'make test' does to
+// check that a graph patched on reload is the graph a full build makes.
+// Components may be numbered differently (see CSDB), so they are compared
+// as partitions of the functions with the same calls between them, and
+// each must only call components numbered lower.
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <set>
+#include <vector>
+#include <unistd.h>
+#include "../db.hh"
+
+static bool same(CSRange a, CSRange b)
+{
+    return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin());
+}
+
+// Report the first difference in section 'sec'
+#define CHECK(sec, cond, ...) do {                             \
+    if (!(cond)) {                                             \
+        printf("%s differs: ", sec);                           \
+        printf(__VA_ARGS__);                                   \
+        printf("\n");                                          \
+        return false;                                          \
+    }                                                          \
+} while (0)
+
+// Whether the callees of 'fn' are listed in order of id
+static bool ordered(const CSDB *db, CSFnId fn)
+{
+    CSRange r = db->getCallees(fn);
+    const uint32_t *order = db->getCalleeOrder(fn);
+
+    for (size_t i=1; i<r.size(); ++i)
+      if (r.first[order[i-1]] >= r.first[order[i]])
+        return false;
+    return true;
+}
+
+static bool compareFunctions(const CSDB *a, const CSDB *b)
+{
+    for (CSFnId i=0; i<a->getFunctionCount(); ++i) {
+        const char *name = a->getName(i);
+        size_t n = a->getCallees(i).size();
+
+        CHECK("names", !strcmp(name, b->getName(i)), "%u", i);
+        CHECK("callees", same(a->getCallees(i), b->getCallees(i)), "%s", name);
+        CHECK("callers", same(a->getCallers(i), b->getCallers(i)), "%s", name);
+        CHECK("ranked callees",
+              same(a->getCalleesRanked(i), b->getCalleesRanked(i)),
+              "%s", name);
+        CHECK("ranked callers",
+              same(a->getCallersRanked(i), b->getCallersRanked(i)),
+              "%s", name);
+        CHECK("callee counts", !memcmp(a->getCalleeCounts(i),
+                                       b->getCalleeCounts(i),
+                                       n * sizeof(uint32_t)), "%s", name);
+        CHECK("callee order", ordered(a, i) && ordered(b, i), "%s", name);
+        CHECK("callee order", !memcmp(a->getCalleeOrder(i),
+                                      b->getCalleeOrder(i),
+                                      n * sizeof(uint32_t)), "%s", name);
+        CHECK("function files",
+              a->getFunctionFile(i) == b->getFunctionFile(i), "%s", name);
+        CHECK("base functions",
+              a->getBaseFunction(i) == b->getBaseFunction(i), "%s", name);
+    }
+
+    CHECK("sorted names", same(a->getPrefix(""), b->getPrefix("")), "order");
+    return true;
+}
+
+static bool compareFiles(const CSDB *a, const CSDB *b, bool hashes)
+{
+    for (size_t f=0; f<a->getFileCount(); ++f) {
+        const char *name = a->getFileName(f);
+
+        CHECK("files", !strcmp(name, b->getFileName(f)), "%zu", f);
+        CHECK("files", !hashes || a->getFileHash(f) == b->getFileHash(f),
+              "hash of %s", name);
+        CHECK("file definitions", a->getFileDefs(f) == b->getFileDefs(f) &&
+              a->getFileDefs(f + 1) == b->getFileDefs(f + 1), "%s", name);
+    }
+
+    for (uint64_t d=0; d<a->getDefCount(); ++d) {
+        size_t n = a->getDefCalls(d).size();
+
+        CHECK("definitions", a->getDefFunction(d) == b->getDefFunction(d),
+              "%llu", (unsigned long long)d);
+        CHECK("definition calls", same(a->getDefCalls(d), b->getDefCalls(d)),
+              "%llu", (unsigned long long)d);
+        CHECK("call lines", !memcmp(a->getDefCallLines(d),
+                                    b->getDefCallLines(d),
+                                    n * sizeof(uint32_t)),
+              "%llu", (unsigned long long)d);
+        CHECK("definition lines", a->getDefLine(d) == b->getDefLine(d),
+              "%llu", (unsigned long long)d);
+        CHECK("definition flags", a->isDefStatic(d) == b->isDefStatic(d),
+              "%llu", (unsigned long long)d);
+        CHECK("definition files", a->getDefFile(d) == b->getDefFile(d),
+              "%llu", (unsigned long long)d);
+    }
+
+    return true;
+}
+
+// 'to' takes a's components to b's
+static bool compareComponents(const CSDB *a, const CSDB *b)
+{
+    std::vector<CSSccId> to(a->getSccCount(), UINT32_MAX);
+
+    CHECK("components", a->getSccCount() == b->getSccCount(),
+          "%zu and %zu", a->getSccCount(), b->getSccCount());
+    for (CSFnId i=0; i<a->getFunctionCount(); ++i) {
+        CSSccId c = a->getScc(i);
+        if (to[c] == UINT32_MAX)
+          to[c] = b->getScc(i);
+        CHECK("components", to[c] == b->getScc(i), "%s", a->getName(i));
+    }
+
+    for (CSSccId c=0; c<a->getSccCount(); ++c) {
+        std::set<CSSccId> a_succs, b_succs, a_preds, b_preds;
+
+        CHECK("component functions", a->getSccFunctions(c).size() ==
+              b->getSccFunctions(to[c]).size(), "%u", c);
+        for (auto fn: b->getSccFunctions(to[c]))
+          CHECK("component functions", b->getScc(fn) == to[c], "%u", c);
+        for (auto s: a->getSccCallees(c))
+          a_succs.insert(to[s]);
+        for (auto s: b->getSccCallees(to[c])) {
+            CHECK("component order", s < to[c], "%u", to[c]);
+            b_succs.insert(s);
+        }
+        for (auto p: a->getSccCallers(c))
+          a_preds.insert(to[p]);
+        for (auto p: b->getSccCallers(to[c]))
+          b_preds.insert(p);
+        CHECK("component callees", a_succs == b_succs, "%u", c);
+        CHECK("component callers", a_preds == b_preds, "%u", c);
+    }
+
+    return true;
+}
+
+static bool compare(const CSDB *a, const CSDB *b, bool hashes)
+{
+    CHECK("counts", a->getFunctionCount() == b->getFunctionCount() &&
+          a->getEdgeCount() == b->getEdgeCount() &&
+          a->getFileCount() == b->getFileCount() &&
+          a->getDefCount() == b->getDefCount() &&
+          a->getCallCount() == b->getCallCount(),
+          "%zu and %zu functions, %zu and %zu edges",
+          a->getFunctionCount(), b->getFunctionCount(),
+          a->getEdgeCount(), b->getEdgeCount());
+
+    return compareFunctions(a, b) && compareFiles(a, b, hashes) &&
+           compareComponents(a, b);
+}
+
+static void usage(const char *execname)
+{
+    printf("Usage: %s [-H] a.fnplot b.fnplot\n"
+           "  -H: Ignore the files' content hashes, for databases written\n"
+           "      differently (such as compressed and not).\n"
+           "  -h: This help message.\n",
+           execname);
+    exit(EXIT_SUCCESS);
+}
+
+int main(int argc, char **argv)
+{
+    int opt;
+    bool hashes = true;
+    CSDB *a, *b;
+
+    while ((opt = getopt(argc, argv, "Hh")) != -1) {
+        switch (opt) {
+        case 'H': hashes = false; break;
+        case 'h': usage(argv[0]); break;
+        default: return EXIT_FAILURE;
+        }
+    }
+
+    if (optind != argc - 2) {
+        fprintf(stderr, "Invalid options, see '-h'\n");
+        return EXIT_FAILURE;
+    }
+
+    a = CSDB::load(argv[optind]);
+    b = CSDB::load(argv[optind + 1]);
+    if (!a || !b) {
+        fprintf(stderr, "%s: Not a snapshot\n", argv[optind + (a != NULL)]);
+        return EXIT_FAILURE;
+    }
+
+    return compare(a, b, hashes) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
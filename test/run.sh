@@ -0,0 +1,230 @@
+#!/bin/sh
+#*******************************************************************************
+# Copyright (c) 2016, enferex <mattdavis9@gmail.com>
+#
+# ISC License:
+# https://www.isc.org/downloads/software-support-policy/isc-license/
+#
+# Permission to use, copy, modify, and/or distribute this software for any
+# purpose with or without fee is hereby granted, provided that the above
+# copyright notice and this permission notice appear in all copies.
+#
+# THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+# REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+# AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+# INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+# LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+# OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+# PERFORMANCE OF THIS SOFTWARE.
+#*******************************************************************************
+
+# Run by 'make test'.  Each test runs fnplot on databases that bench/csgen
+# generates, and checks that the ways of getting at the same graph agree:
+# threads, streaming, pipes, snapshots, patched reloads, batches, formats
+# and merging.
+#
+# Usage: test/run.sh [fnplot [csgen [csedit [dbcmp]]]]
+
+FNPLOT=${1:-./fnplot}
+CSGEN=${2:-./bench/csgen}
+CSEDIT=${3:-./test/csedit}
+DBCMP=${4:-./test/dbcmp}
+T=$(mktemp -d) || exit 1
+trap 'rm -rf "$T"' EXIT
+n_pass=0
+n_fail=0
+
+# check <name> <command...>: the command must succeed
+check()
+{
+    name=$1
+    shift
+    if "$@"; then
+        n_pass=$((n_pass + 1))
+    else
+        n_fail=$((n_fail + 1))
+        echo "FAIL: $name"
+    fi
+}
+
+# fnplot quietly (progress goes to stderr)
+fnplot()
+{
+    "$FNPLOT" "$@" 2>/dev/null
+}
+
+# Number of edges in dot on stdin
+dotEdges()
+{
+    grep -c -- ' -> '
+}
+
+# Number of edges in json on stdin
+jsonEdges()
+{
+    grep -o '\[[0-9]*, [0-9]*\]' | wc -l
+}
+
+# Did the fnplot whose --stats are in file $1 scan less than the database?
+partial()
+{
+    db=$(grep -o '"database_bytes": [0-9]*' "$1" | grep -o '[0-9]*$')
+    scanned=$(grep -o '"bytes_scanned": [0-9]*' "$1" | grep -o '[0-9]*$')
+    test -n "$scanned" && test "$scanned" -lt "$db"
+}
+
+"$CSGEN" -f 40 -n 800 -o 4 -y 0.1 "$T/cscope.out" || exit 1
+DB=$T/cscope.out
+
+# The callees and callers that every other way must agree with
+fnplot -c "$DB" -f 'fn_1*' -y -d 3 -o "$T/y.dot"
+fnplot -c "$DB" -f 'fn_4*' -x -d 3 -o "$T/x.dot"
+check "callees found" test "$(dotEdges < "$T/y.dot")" -gt 0
+check "callers found" test "$(dotEdges < "$T/x.dot")" -gt 0
+
+# Threads, windows, pipes and snapshots all build the same graph
+for opts in "-j 4" "-m 1" "-s" "-s"; do
+    fnplot -c "$DB" $opts -f 'fn_1*' -y -d 3 -o "$T/y2.dot"
+    check "callees with $opts" cmp -s "$T/y.dot" "$T/y2.dot"
+    fnplot -c "$DB" $opts -f 'fn_4*' -x -d 3 -o "$T/x2.dot"
+    check "callers with $opts" cmp -s "$T/x.dot" "$T/x2.dot"
+done
+check "snapshot written" test -s "$DB.fnplot"
+
+# A damaged snapshot is built again rather than read out of bounds.  The
+# first callee edge is pointed past the functions: the callee edges are
+# section 4, whose offset follows 104 bytes of counts (see CSDBHeader).
+off=$(od -An -t u8 -j $((104 + 16 * 4)) -N 8 "$DB.fnplot" | tr -d ' ')
+printf '\377\377\377\377' |
+    dd of="$DB.fnplot" bs=1 seek="$off" conv=notrunc 2>/dev/null
+fnplot -c "$DB" -s -f 'fn_1*' -y -d 3 -o "$T/y2.dot"
+check "damaged snapshot" cmp -s "$T/y.dot" "$T/y2.dot"
+fnplot -c - -f 'fn_1*' -y -d 3 -o "$T/y2.dot" < "$DB"
+check "callees from a pipe" cmp -s "$T/y.dot" "$T/y2.dot"
+
+# Reloading an edited database patches its snapshot into the graph that a
+# full build makes.  Times are set, as edits can keep the size the same.
+cp "$DB" "$T/p.out"
+fnplot -c "$T/p.out" -s -f fn_1 -y -o /dev/null
+n_patched=0
+i=0
+for kind in static remove add mix; do
+    for seed in 1 2 3 4 5; do
+        i=$((i + 1))
+        "$CSEDIT" -k $kind -n 3 -s $seed "$T/p.out"
+        touch -d "@$((1500000000 + i))" "$T/p.out"
+        "$FNPLOT" -c "$T/p.out" -s -f fn_1 -y -o /dev/null --stats \
+            2> "$T/stats"
+        if grep -q '"patched_graphs": 1' "$T/stats"; then
+            n_patched=$((n_patched + 1))
+        fi
+        cp "$T/p.out" "$T/f.out"
+        fnplot -c "$T/f.out" -s -f fn_1 -y -o /dev/null
+        check "reload after $kind edits ($seed)" \
+              "$DBCMP" "$T/f.out.fnplot" "$T/p.out.fnplot"
+    done
+done
+check "reloads patched" test $n_patched -ge 15
+
+# A compressed database, as cscope writes without -c, is the same graph.
+# Its symbols have digraphs to expand, and its "static" is a single byte,
+# which decides which of the static helpers' namesakes keeps the name.
+"$CSGEN" -t 0.2 -f 40 -n 800 -o 4 -y 0.1 "$T/c.out" || exit 1
+"$CSGEN" -t 0.2 -z -f 40 -n 800 -o 4 -y 0.1 "$T/z.out" || exit 1
+check "static keyword" grep -q "$(printf '\030')" "$T/z.out"
+fnplot -c "$T/c.out" -s -f fn_1 -y -o /dev/null
+fnplot -c "$T/z.out" -s -f fn_1 -y -o /dev/null
+check "compressed" "$DBCMP" -H "$T/c.out.fnplot" "$T/z.out.fnplot"
+fnplot -c "$T/c.out" -f 'fn_1*' -y -d 3 -o "$T/c.dot"
+fnplot -c "$T/z.out" -m 1 -f 'fn_1*' -y -d 3 -o "$T/z.dot"
+check "compressed in windows" cmp -s "$T/c.dot" "$T/z.dot"
+
+# With the inverted index that cscope -q builds, a query only parses the
+# files that it reaches, and plots what a full load does.  Had the index
+# been found inconsistent, the whole database would have been parsed.
+mkdir "$T/q"
+"$CSGEN" -t 0.2 -q -f 40 -n 800 -o 4 -y 0.1 "$T/q/cscope.out" || exit 1
+for query in "fn_200 -x -d 3" "fn_200 -y -d 3" "fn_600 -x -y -d 2"; do
+    "$FNPLOT" -c "$T/q/cscope.out" -f $query -o "$T/q.dot" --stats \
+        2> "$T/stats"
+    fnplot -c "$T/c.out" -f $query -o "$T/c.dot"
+    check "index: $query" cmp -s "$T/c.dot" "$T/q.dot"
+    check "index consistent: $query" test -z "$(grep inconsistent "$T/stats")"
+    check "index parses less: $query" partial "$T/stats"
+done
+
+# A database merged with itself is the same graph
+fnplot -c "$DB" -c "$DB" -f 'fn_1*' -y -d 3 -o "$T/y2.dot"
+check "merged callees" cmp -s "$T/y.dot" "$T/y2.dot"
+
+# Databases in different directories keep their files apart, though cscope
+# names the files alike
+mkdir "$T/a" "$T/b"
+"$CSGEN" -f 4 -n 40 -o 3 "$T/a/cscope.out" || exit 1
+"$CSGEN" -f 4 -n 40 -o 3 -s 2 "$T/b/cscope.out" || exit 1
+fnplot -c "$T/a/cscope.out" -c "$T/b/cscope.out" -f 'fn_*' -y \
+    --collapse file -o "$T/f.dot"
+check "merged files" grep -qF "\"$T/b/src/mod" "$T/f.dot"
+"$FNPLOT" -c "$DB" -c "$DB" -f fn_1 -o /dev/null --stats 2> "$T/stats"
+check "files merged once" grep -q '"files": 40' "$T/stats"
+
+# ... and has not changed since itself
+fnplot -c "$DB" -D "$DB" -f 'fn_1*' -y -o "$T/d.dot"
+check "no changes" test "$(dotEdges < "$T/d.dot")" -eq 0
+
+# Formats describe the same edges
+fnplot -c "$DB" -f 'fn_1*' -y -d 3 -F json -o "$T/y.json"
+check "json edges" test "$(jsonEdges < "$T/y.json")" -eq \
+                        "$(dotEdges < "$T/y.dot")"
+fnplot -c "$DB" -f 'fn_1*' -y -d 3 -F binary -o "$T/y.bin"
+check "binary record" test "$(head -c 4 "$T/y.bin")" = FNG1
+
+# A batch answers each query as it would be answered alone
+printf 'fn_10\nfn_20\nfn_30\n' > "$T/names"
+: > "$T/each.dot"
+for fn in fn_10 fn_20 fn_30; do
+    fnplot -c "$DB" -f $fn -y -d 2 >> "$T/each.dot"
+done
+fnplot -c "$DB" -b "$T/names" -y -d 2 -j 2 -o "$T/batch.dot"
+check "batch" cmp -s "$T/each.dot" "$T/batch.dot"
+mkdir "$T/out"
+fnplot -c "$DB" -b "$T/names" -y -d 2 -O "$T/out"
+check "batch files" test -s "$T/out/fn_10.dot" -a -s "$T/out/fn_30.dot"
+
+# Patterns take in every match
+fnplot -c "$DB" -f '/^fn_1[0-9]$/' -y -d 3 -o "$T/y2.dot"
+check "regex pattern" test "$(dotEdges < "$T/y2.dot")" -gt 0
+
+# Titles are quoted like names
+fnplot -c "$DB" -f '/^fn_1[0-9]"?$/' -y -d 1 -o "$T/y2.dot"
+check "quoted title" \
+      grep -qxF 'digraph "Callees of /^fn_1[0-9]\"?$/" {' "$T/y2.dot"
+
+# A function reaches, and has a call path to, each function it calls
+fn=$(sed -n 's/^    \(fn_[0-9]*\) -> \(fn_[0-9]*\)$/\1 \2/p' "$T/y.dot" |
+     head -1)
+check "call path" test -n "$(fnplot -c "$DB" -f ${fn% *} -t ${fn#* } -T)"
+fnplot -c "$DB" -f ${fn% *} -y -r -o "$T/r.txt"
+check "reach" grep -qx "${fn#* }" "$T/r.txt"
+
+# Every call counted is found, from the graph built or the snapshot
+fnplot -c "$DB" -f 'fn_4*' -x -d 3 --counts -o "$T/x2.dot"
+check "call counts" grep -q 'label=[1-9]' "$T/x2.dot"
+check "no uncounted calls" test -z "$(grep 'label=0' "$T/x2.dot")"
+fnplot -c "$DB" -s -f 'fn_4*' -x -d 3 --counts -o "$T/x3.dot"
+check "call counts from snapshot" cmp -s "$T/x2.dot" "$T/x3.dot"
+
+# Limits truncate, and say so
+fnplot -c "$DB" -f 'fn_1*' -y -d 0 --max-nodes 5 -o "$T/y2.dot"
+check "node limit" grep -q 'truncated: node limit' "$T/y2.dot"
+
+# Collapsing keeps to files
+fnplot -c "$DB" -f 'fn_1*' -y -d 3 --collapse file -o "$T/f.dot"
+check "collapse by file" grep -q '"src/mod' "$T/f.dot"
+
+# --stats reports JSON
+"$FNPLOT" -c "$DB" -f fn_10 -y --stats -o /dev/null 2> "$T/stats"
+check "stats" grep -q '"phases"' "$T/stats"
+
+echo "$n_pass passed, $n_fail failed"
+test $n_fail -eq 0